@@ -7,6 +7,7 @@
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/workqueue.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -73,7 +74,8 @@ struct channel
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
-    struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct semaphore completion_wait;   /* Up'd by completion_work. */
+    struct work completion_work;        /* Raised by interrupt handler. */
 
     struct disk devices[2];     /* The devices on this channel. */
   };
@@ -97,6 +99,7 @@ static void select_device (const struct disk *);
 static void select_device_wait (const struct disk *);
 
 static void interrupt_handler (struct intr_frame *);
+static work_func complete;
 
 /* Initialize the disk subsystem and detect disks. */
 void
@@ -127,6 +130,7 @@ disk_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      work_init (&c->completion_work, complete, c);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -546,25 +550,35 @@ select_device_wait (const struct disk *d)
   wait_until_idle (d);
 }
 
-/* ATA interrupt handler. */
+/* ATA interrupt handler.  Only acknowledges the interrupt,
+   leaving the waiter to be woken up by complete() in the softirq
+   pass. */
 static void
 interrupt_handler (struct intr_frame *f) 
 {
   struct channel *c;
 
-  for (c = channels; c < channels + CHANNEL_CNT; c++)
-    if (f->vec_no == c->irq)
-      {
-        if (c->expecting_interrupt) 
-          {
-            inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
-          }
-        else
-          printf ("%s: unexpected interrupt\n", c->name);
-        return;
-      }
+  /* Channel N uses IRQ 14 + N. */
+  ASSERT (f->vec_no >= 14 + 0x20 && f->vec_no < 14 + 0x20 + CHANNEL_CNT);
+  c = &channels[f->vec_no - (14 + 0x20)];
+  ASSERT (f->vec_no == c->irq);
+
+  if (c->expecting_interrupt) 
+    {
+      inb (reg_status (c));               /* Acknowledge interrupt. */
+      softirq_raise (&c->completion_work);
+    }
+  else
+    printf ("%s: unexpected interrupt\n", c->name);
+}
+
+/* Wakes up the thread waiting for channel C_ to complete a
+   command. */
+static void
+complete (void *c_) 
+{
+  struct channel *c = c_;
 
-  NOT_REACHED ();
+  sema_up (&c->completion_wait);
 }
 
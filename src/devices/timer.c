@@ -7,7 +7,7 @@
 #include "threads/io.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
-#include "threads/malloc.h"
+#include "threads/workqueue.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -25,22 +25,87 @@ static unsigned loops_per_tick;
 /* Number of timer ticks since OS booted. */
 static uint64_t ticks;
 
-struct sleep_elem
-{
-      struct list_elem elem;
-      struct semaphore sleep_sema;
-      unsigned wakeup_time;
-      bool initialized;
-};
-
-struct list sleep_list;
+/* Time stamp counter clock source.  timer_calibrate() measures
+   the TSC rate against the PIT and derives TSC_MULT such that
+   nanoseconds = cycles * TSC_MULT / 2**TSC_SHIFT.  Both stay 0
+   if the CPU has no TSC. */
+#define CALIBRATE_TICKS 10              /* Ticks to calibrate over. */
+#define TSC_SHIFT 22
+static bool tsc_present;                /* CPU has a TSC? */
+static uint64_t tsc_hz;                 /* TSC cycles per second. */
+static uint64_t tsc_mult;               /* Cycles to ns multiplier. */
+
+/* Sleeping threads are kept in a hierarchical timer wheel,
+   indexed by wake-up time.  The first level has one slot per
+   tick for the next TV0_SIZE ticks.  Each further level has
+   TVN_SIZE slots, each covering as many ticks as the whole level
+   below it.  When the first level wraps around, the next slot of
+   the level above is "cascaded", that is, its threads are
+   redistributed into the levels below.  A thread's slot is
+   computed from its wake-up time, so insertion is O(1), and
+   every thread in the current first-level slot is due, so the
+   timer interrupt never looks at a thread that is not waking
+   up.  Threads sleeping longer than the wheel's range are parked
+   as far out as the top level reaches and re-inserted when that
+   slot cascades. */
+#define TV0_BITS 8
+#define TVN_BITS 6
+#define TV0_SIZE (1 << TV0_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TV0_MASK (TV0_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_CNT 3                       /* Levels above the first. */
+#define WHEEL_MAX (((int64_t) 1 << (TV0_BITS + TVN_CNT * TVN_BITS)) - 1)
+
+static struct list tv0[TV0_SIZE];       /* First level, one tick each. */
+static struct list tvn[TVN_CNT][TVN_SIZE]; /* Upper levels. */
+static int64_t wheel_time;              /* Next tick to be processed. */
+static struct work wheel_work;          /* Runs wheel_run() in a softirq. */
+
+/* Clock event device.
+
+   If the CPU has a local APIC, timer_calibrate() measures its
+   timer against the PIT and then takes over from the PIT, which
+   is stopped.  The local APIC timer runs in one-shot mode and is
+   always armed for the earliest pending event: the next tick,
+   or the deadline of a sub-tick sleep.  Time is kept in local
+   APIC timer counts since the switch-over, by adding up the
+   counts consumed by each programmed interval.
+
+   While the idle thread halts the CPU, the tick is suppressed:
+   the timer is armed for the next sleeper's wake-up tick
+   instead, and whichever interrupt ends the halt first catches
+   the tick count up. */
+#define LAPIC_TIMER_DIV_16 0x3          /* Divide bus clock by 16. */
+
+static bool ce_active;                  /* Local APIC timer in use? */
+static uint32_t counts_per_tick;        /* Local APIC timer rate. */
+static uint64_t ce_start;               /* Time programmed interval began. */
+static uint32_t ce_initial;             /* Length of programmed interval. */
+static uint64_t next_tick_count;        /* Time of the next tick. */
+static struct list hr_list;             /* Sub-tick sleepers, by deadline. */
+static bool idle_stopped;               /* Tick stopped for idle? */
+
+/* Tickless idle statistics. */
+static long long idle_cnt;              /* # of tickless idle periods. */
+static long long idle_skipped;          /* # of ticks they covered. */
 
 static intr_handler_func timer_interrupt;
+static intr_handler_func lapic_timer_interrupt;
+static void clocks_calibrate (void);
+static void lapic_timer_start (void);
+static uint64_t ce_now (void);
+static void ce_program (uint64_t deadline);
+static void ce_update (void);
+static void hr_sleep (int64_t num, int32_t denom);
+static list_less_func hr_less;
+static int64_t wheel_next_expiry (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
-static list_less_func timer_less;
-struct sleep_elem sleep_entry (struct list_elem *);
+static void wheel_insert (struct thread *);
+static int wheel_cascade (int level, int index);
+static work_func wheel_run;
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
@@ -51,16 +116,27 @@ timer_init (void)
   /* 8254 input frequency divided by TIMER_FREQ, rounded to
      nearest. */
   uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
+  int i, j;
 
   outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
   outb (0x40, count & 0xff);
   outb (0x40, count >> 8);
 
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  list_init (&sleep_list);
+
+  for (i = 0; i < TV0_SIZE; i++)
+    list_init (&tv0[i]);
+  for (i = 0; i < TVN_CNT; i++)
+    for (j = 0; j < TVN_SIZE; j++)
+      list_init (&tvn[i][j]);
+  list_init (&hr_list);
+  work_init (&wheel_work, wheel_run, NULL);
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and the TSC and local APIC timer rates.  Then switches the
+   tick over to the local APIC timer, if there is a local
+   APIC. */
 void
 timer_calibrate (void) 
 {
@@ -83,6 +159,102 @@ timer_calibrate (void)
       loops_per_tick |= test_bit;
 
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+
+  clocks_calibrate ();
+  if (lapic_available ())
+    lapic_timer_start ();
+}
+
+/* Reads the time stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+
+  /* See [IA32-v2b] "RDTSC". */
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Measures the TSC and, if present, the local APIC timer over
+   CALIBRATE_TICKS ticks of the PIT. */
+static void
+clocks_calibrate (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  uint64_t tsc_start = 0;
+  uint64_t start;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  /* CPUID leaf 1, EDX bit 4: time stamp counter. */
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  tsc_present = (edx & (1 << 4)) != 0;
+
+  if (lapic_available ())
+    {
+      lapic_write (LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+      lapic_write (LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VEC);
+    }
+
+  /* Start on a tick boundary. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+  if (tsc_present)
+    tsc_start = rdtsc ();
+  if (lapic_available ())
+    lapic_write (LAPIC_TIMER_INIT, UINT32_MAX);
+
+  start = ticks;
+  while (ticks - start < CALIBRATE_TICKS)
+    barrier ();
+
+  if (lapic_available ())
+    {
+      counts_per_tick = ((UINT32_MAX - lapic_read (LAPIC_TIMER_CUR))
+                         / CALIBRATE_TICKS);
+      ASSERT (counts_per_tick > 0);
+    }
+  if (tsc_present)
+    {
+      tsc_hz = (rdtsc () - tsc_start) * TIMER_FREQ / CALIBRATE_TICKS;
+      tsc_mult = ((uint64_t) 1000000000 << TSC_SHIFT) / tsc_hz;
+      printf ("TSC: %'"PRIu64" cycles/s.\n", tsc_hz);
+    }
+}
+
+/* Returns the number of TSC cycles since the CPU was reset.
+   Safe to call from any context, including interrupt handlers,
+   without disabling interrupts.  Returns 0 if the CPU has no
+   TSC. */
+uint64_t
+timer_cycles (void)
+{
+  return tsc_present ? rdtsc () : 0;
+}
+
+/* Converts CYCLES, a difference between two values returned by
+   timer_cycles(), to nanoseconds.  The high and low bits are
+   scaled separately, so that the product cannot overflow for
+   any realistic uptime. */
+uint64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  uint64_t low_mask = ((uint64_t) 1 << TSC_SHIFT) - 1;
+
+  return ((cycles >> TSC_SHIFT) * tsc_mult
+          + (((cycles & low_mask) * tsc_mult) >> TSC_SHIFT));
+}
+
+/* Returns the number of nanoseconds since the CPU was reset,
+   with the precision of the TSC.  Like timer_cycles(), safe to
+   call from any context.  Returns 0 until timer_calibrate() has
+   run. */
+uint64_t
+timer_ns (void)
+{
+  return timer_cycles_to_ns (timer_cycles ());
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -108,43 +280,16 @@ timer_elapsed (int64_t then)
 void
 timer_sleep (int64_t ticks) 
 {  
-  if (ticks <= 0) return;
-  enum intr_level old_level = intr_disable();
-
-  int64_t wakeup_time = timer_ticks()+ticks;
-  struct sleep_elem *this = (struct sleep_elem*) 
-		  	       malloc(sizeof(struct sleep_elem));
-  this->wakeup_time = wakeup_time;
-
-  list_insert_ordered(&sleep_list, &(this->elem), timer_less, NULL);
-
-  unsigned int list_size_then = list_size(&sleep_list); 
-  list_unique(&sleep_list, NULL, timer_less, NULL);
-  unsigned int list_size_now = list_size (&sleep_list); 
-
-  //if (list_size_now < list_size_then)
-    //free (this);
-  
-  struct list_elem *e;
-  struct sleep_elem *s;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-  for (e = list_begin (&sleep_list); e != list_end(&sleep_list); 
-       e = list_next (e))
-    {
-      s = list_entry (e, struct sleep_elem, elem);
-      if (s->wakeup_time == wakeup_time)
-       break;
-    }
- 
-  if (!(s->initialized))
-   {
-     sema_init (&(s->sleep_sema), 0);
-     s->initialized=true;
-   }
+  if (ticks <= 0) return;
 
+  old_level = intr_disable ();
+  cur->wakeup_time = timer_ticks () + ticks;
+  wheel_insert (cur);
+  thread_block ();
   intr_set_level (old_level);
-
-  sema_down (&(s->sleep_sema)); 
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -173,24 +318,319 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (ce_active)
+    printf ("Timer: %lld tickless idle periods covering %lld ticks\n",
+            idle_cnt, idle_skipped);
+}
+
+/* Stops the timer tick until the next sleeping thread is due.
+   Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  Does nothing without a local APIC timer. */
+void
+timer_idle (void)
+{
+  uint64_t deadline;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (!ce_active)
+    return;
+
+  /* next_tick_count is the time of tick number TICKS + 1. */
+  deadline = next_tick_count
+             + (wheel_next_expiry () - (int64_t) ticks - 1) * counts_per_tick;
+  if (!list_empty (&hr_list))
+    {
+      struct thread *t = list_entry (list_front (&hr_list),
+                                     struct thread, sleep_elem);
+      if ((uint64_t) t->wakeup_time < deadline)
+        deadline = t->wakeup_time;
+    }
+  if (deadline > next_tick_count)
+    {
+      ce_program (deadline);
+      idle_stopped = true;
+      idle_cnt++;
+    }
+}
+
+/* Restarts the timer tick after timer_idle() stopped it, first
+   accounting for the ticks that passed during the halt.  Called
+   on entry to every external interrupt handler. */
+void
+timer_idle_exit (void)
+{
+  int64_t start;
+
+  if (!idle_stopped)
+    return;
+  idle_stopped = false;
+
+  start = ticks;
+  ce_update ();
+  idle_skipped += ticks - start;
 }
 
-/* Timer interrupt handler. */
+/* PIT interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 { 
-  ticks++;
-  struct sleep_elem *s = list_entry (list_begin (&sleep_list), 
-				       struct sleep_elem, elem);
-  if (s->wakeup_time == ticks)
-   {
-     sema_broadcast (&s->sleep_sema);
-     list_remove (list_begin (&sleep_list));
-   }
+  /* The PIT fires once more after lapic_timer_start() stops it. */
+  if (ce_active)
+    return;
 
+  ticks++;
+  softirq_raise (&wheel_work);
   thread_tick ();
 }
 
+/* Local APIC timer interrupt handler. */
+static void
+lapic_timer_interrupt (struct intr_frame *args UNUSED)
+{
+  ce_update ();
+}
+
+/* Makes the local APIC timer, already calibrated by
+   clocks_calibrate(), the source of timer ticks and stops the
+   PIT. */
+static void
+lapic_timer_start (void)
+{
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  old_level = intr_disable ();
+
+  /* Stop the PIT by reprogramming it to fire once more. */
+  outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+  outb (0x40, 0xff);
+  outb (0x40, 0xff);
+
+  /* Stop the local APIC timer, which makes the current time 0,
+     and arm it in one-shot mode for the next tick. */
+  lapic_write (LAPIC_TIMER_INIT, 0);
+  ce_start = ce_initial = 0;
+  next_tick_count = counts_per_tick;
+  intr_register_local (LAPIC_TIMER_VEC, lapic_timer_interrupt, 
+                       "LAPIC Timer");
+  lapic_write (LAPIC_LVT_TIMER, LAPIC_TIMER_VEC);
+  ce_active = true;
+  ce_program (next_tick_count);
+
+  intr_set_level (old_level);
+
+  printf ("Local APIC timer: %'"PRIu64" counts/s, tickless idle.\n",
+          (uint64_t) counts_per_tick * TIMER_FREQ);
+}
+
+/* Returns the current time, in local APIC timer counts since
+   lapic_timer_start().  Once a one-shot interval expires, the
+   count stays at 0, so time stands still until ce_program()
+   starts the next interval; ce_update() does so promptly.
+   Interrupts must be off. */
+static uint64_t
+ce_now (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return ce_start + (ce_initial - lapic_read (LAPIC_TIMER_CUR));
+}
+
+/* Arms the local APIC timer to interrupt at DEADLINE, or as soon
+   as possible if DEADLINE has passed.  Intervals longer than the
+   32-bit counter allows are cut short.  Interrupts must be
+   off. */
+static void
+ce_program (uint64_t deadline)
+{
+  uint64_t now = ce_now ();
+  uint64_t delta = deadline > now ? deadline - now : 1;
+
+  if (delta > UINT32_MAX)
+    delta = UINT32_MAX;
+  ce_start = now;
+  ce_initial = delta;
+  lapic_write (LAPIC_TIMER_INIT, ce_initial);
+}
+
+/* Processes every tick and sub-tick deadline that has passed,
+   then arms the local APIC timer for the next one.  Runs in
+   external interrupt context. */
+static void
+ce_update (void)
+{
+  uint64_t now = ce_now ();
+  uint64_t next;
+
+  while (now >= next_tick_count)
+    {
+      next_tick_count += counts_per_tick;
+      ticks++;
+      softirq_raise (&wheel_work);
+      thread_tick ();
+    }
+
+  next = next_tick_count;
+  while (!list_empty (&hr_list))
+    {
+      struct thread *t = list_entry (list_front (&hr_list),
+                                     struct thread, sleep_elem);
+      if ((uint64_t) t->wakeup_time > now)
+        {
+          if ((uint64_t) t->wakeup_time < next)
+            next = t->wakeup_time;
+          break;
+        }
+      list_pop_front (&hr_list);
+      thread_unblock (t);
+    }
+
+  ce_program (next);
+}
+
+/* Blocks the current thread for NUM/DENOM seconds, which must be
+   less than one timer tick, using a one-shot local APIC timer
+   interrupt to wake it up. */
+static void
+hr_sleep (int64_t num, int32_t denom)
+{
+  struct thread *cur = thread_current ();
+  int64_t counts = num * counts_per_tick * TIMER_FREQ / denom;
+  enum intr_level old_level;
+
+  if (counts <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_time = ce_now () + counts;
+  list_insert_ordered (&hr_list, &cur->sleep_elem, hr_less, NULL);
+  if ((uint64_t) cur->wakeup_time < ce_start + ce_initial)
+    ce_program (cur->wakeup_time);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Orders sub-tick sleepers by deadline. */
+static bool
+hr_less (const struct list_elem *a_, const struct list_elem *b_,
+         void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = list_entry (b_, struct thread, sleep_elem);
+
+  return a->wakeup_time < b->wakeup_time;
+}
+
+/* Adds sleeping thread T to the timer wheel slot for its
+   wake-up time.  Interrupts must be off. */
+static void
+wheel_insert (struct thread *t)
+{
+  int64_t expires = t->wakeup_time;
+  int64_t idx = expires - wheel_time;
+  struct list *slot;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (idx < 0)
+    {
+      /* Already due: wake up on the next tick processed. */
+      slot = &tv0[wheel_time & TV0_MASK];
+    }
+  else if (idx < TV0_SIZE)
+    slot = &tv0[expires & TV0_MASK];
+  else
+    {
+      int level = 0;
+
+      if (idx > WHEEL_MAX)
+        {
+          expires = wheel_time + WHEEL_MAX;
+          idx = WHEEL_MAX;
+        }
+      while (idx >= (int64_t) 1 << (TV0_BITS + (level + 1) * TVN_BITS))
+        level++;
+      slot = &tvn[level][(expires >> (TV0_BITS + level * TVN_BITS)) 
+                         & TVN_MASK];
+    }
+  list_push_back (slot, &t->sleep_elem);
+}
+
+/* Moves every thread in slot INDEX of upper level LEVEL down to
+   the slot its wake-up time now maps to.  Returns INDEX, so
+   that the caller can cascade the next level up when INDEX has
+   wrapped to 0. */
+static int
+wheel_cascade (int level, int index)
+{
+  struct list *slot = &tvn[level][index];
+  struct list pending;
+
+  /* Detach the slot first: a thread parked beyond the wheel's
+     range may be re-inserted into this same slot. */
+  list_init (&pending);
+  if (!list_empty (slot))
+    list_splice (list_end (&pending), list_begin (slot), list_end (slot));
+
+  while (!list_empty (&pending))
+    wheel_insert (list_entry (list_pop_front (&pending), 
+                              struct thread, sleep_elem));
+  return index;
+}
+
+/* Advances the timer wheel up to the current tick, waking up
+   every thread whose wake-up time has been reached.  Runs in the
+   softirq pass of the timer interrupt, after the interrupt has
+   been acknowledged, and catches up on every tick since it last
+   ran.  All the sleepers due are unblocked in one pass, so any
+   number of them costs at most one yield on interrupt return.
+   Interrupts are off only while a single tick is processed. */
+static void
+wheel_run (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      int index = wheel_time & TV0_MASK;
+      struct list *slot = &tv0[index];
+      int level;
+
+      if (wheel_time > (int64_t) ticks)
+        {
+          intr_set_level (old_level);
+          break;
+        }
+
+      if (index == 0)
+        for (level = 0; level < TVN_CNT; level++)
+          if (wheel_cascade (level, (wheel_time >> (TV0_BITS 
+                                                    + level * TVN_BITS))
+                                    & TVN_MASK) != 0)
+            break;
+
+      while (!list_empty (slot))
+        thread_unblock (list_entry (list_pop_front (slot), 
+                                    struct thread, sleep_elem));
+      wheel_time++;
+      intr_set_level (old_level);
+    }
+}
+
+/* Returns the earliest tick at which wheel_run() has work to do:
+   the first tick with a sleeper due, or the next cascade,
+   whichever comes first.  Looks at no more than TV0_SIZE
+   slots. */
+static int64_t
+wheel_next_expiry (void)
+{
+  int64_t t;
+
+  for (t = wheel_time; ; t++)
+    if ((t != wheel_time && (t & TV0_MASK) == 0)
+        || !list_empty (&tv0[t & TV0_MASK]))
+      return t;
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -243,6 +683,12 @@ real_time_sleep (int64_t num, int32_t denom)
          processes. */                
       timer_sleep (ticks); 
     }
+  else if (ce_active)
+    {
+      /* Otherwise, if we have a one-shot timer, block until it
+         fires, for accurate sub-tick timing without spinning. */
+      hr_sleep (num, denom);
+    }
   else 
     {
       /* Otherwise, use a busy-wait loop for more accurate
@@ -252,20 +698,3 @@ real_time_sleep (int64_t num, int32_t denom)
       busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
     }
 }
-
-bool 
-timer_less (const struct list_elem *a,
-            const struct list_elem *b,
-            void *aux UNUSED)
-{
-  struct sleep_elem *sa = list_entry (a, struct sleep_elem, elem);
-  struct sleep_elem *sb = list_entry (b, struct sleep_elem, elem);
-  if(sa->wakeup_time < sb->wakeup_time) return true;
-  else return false;
-}
-
-struct sleep_elem
-sleep_entry (struct list_elem *e)
-{
-return *(list_entry (e, struct sleep_elem, elem));
-}
@@ -0,0 +1,67 @@
+/* Checks that deadlock detection works under the MLFQS, which
+   does no priority donation.
+
+   The main thread acquires lock A, and a child thread acquires
+   lock B and then blocks acquiring A.  When the main thread
+   tries to acquire B, lock_acquire() should find the cycle and
+   fail.  The main thread waits for the child to block on A
+   explicitly, because under the MLFQS the child does not
+   preempt it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func child_func;
+
+static struct lock a, b;
+static struct semaphore ready, done;
+static struct thread *child;
+
+void lock_acquire_test (struct lock *);
+
+void
+test_deadlock_mlfqs (void) 
+{
+  ASSERT (thread_mlfqs);
+
+  lock_init (&a);
+  lock_init (&b);
+  sema_init (&ready, 0);
+  sema_init (&done, 0);
+
+  lock_acquire_test (&a);
+
+  thread_create ("child", PRI_DEFAULT, child_func, NULL);
+  sema_down (&ready);
+  while (child->waiting_lock != &a)
+    thread_yield ();
+
+  lock_acquire_test (&b);
+
+  msg ("main released lock %d.", a.id);
+  lock_release (&a);
+
+  sema_down (&done);
+  msg ("main ends");
+}
+
+static void
+child_func (void *aux UNUSED) 
+{
+  child = thread_current ();
+  lock_acquire_test (&b);
+  sema_up (&ready);
+  lock_acquire_test (&a);
+
+  msg ("child released lock %d.", a.id);
+  lock_release (&a);
+
+  msg ("child released lock %d.", b.id);
+  lock_release (&b);
+
+  msg ("child ends");
+  sema_up (&done);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(deadlock-mlfqs) begin
+(deadlock-mlfqs) main tries to acquire lock 0.
+(deadlock-mlfqs) main acquired lock 0.
+(deadlock-mlfqs) child tries to acquire lock 1.
+(deadlock-mlfqs) child acquired lock 1.
+(deadlock-mlfqs) child tries to acquire lock 0.
+(deadlock-mlfqs) main tries to acquire lock 1.
+(deadlock-mlfqs) main could not acquire lock 1.
+(deadlock-mlfqs) main released lock 0.
+(deadlock-mlfqs) child acquired lock 0.
+(deadlock-mlfqs) child released lock 0.
+(deadlock-mlfqs) child released lock 1.
+(deadlock-mlfqs) child ends
+(deadlock-mlfqs) main ends
+(deadlock-mlfqs) end
+EOF
+pass;
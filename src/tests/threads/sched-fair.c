@@ -0,0 +1,90 @@
+/* Checks that the fair scheduler divides the CPU in proportion
+   to thread weights under a mix of batch and interactive load.
+
+   Two batch threads, one with nice 0 and one with nice 5, spin
+   for 10 seconds counting the timer ticks they see, while an
+   interactive thread repeatedly sleeps for one tick.  The nice
+   0 thread has weight 1024 and the nice 5 thread weight 335, so
+   they should split the CPU about 75% to 25%.  The interactive
+   thread should wake up on nearly every tick, since after each
+   sleep it is behind the batch threads in virtual runtime. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SPIN_TICKS (10 * TIMER_FREQ)
+
+struct thread_info
+  {
+    int64_t start_time;
+    int nice;
+    int count;
+  };
+
+static thread_func batch_thread;
+static thread_func interactive_thread;
+
+void
+test_sched_fair (void)
+{
+  struct thread_info info[3];
+  int i;
+
+  ASSERT (thread_current ()->sched_class == &sched_fair);
+
+  /* Stay ahead of the threads we create, so that we can start
+     them all before any of them runs. */
+  thread_set_nice (-20);
+
+  for (i = 0; i < 3; i++)
+    {
+      info[i].start_time = timer_ticks ();
+      info[i].nice = i == 1 ? 5 : 0;
+      info[i].count = 0;
+    }
+  thread_create ("batch 0", PRI_DEFAULT, batch_thread, &info[0]);
+  thread_create ("batch 1", PRI_DEFAULT, batch_thread, &info[1]);
+  thread_create ("interactive", PRI_DEFAULT, interactive_thread, &info[2]);
+
+  msg ("Sleeping 11 seconds to let threads run, please wait...");
+  timer_sleep (SPIN_TICKS + TIMER_FREQ);
+
+  for (i = 0; i < 2; i++)
+    msg ("Batch thread %d (nice %d) received %d ticks.",
+         i, info[i].nice, info[i].count);
+  msg ("Interactive thread woke up %d times in %d ticks.",
+       info[2].count, SPIN_TICKS);
+}
+
+static void
+batch_thread (void *ti_)
+{
+  struct thread_info *ti = ti_;
+  int64_t last_time = 0;
+
+  thread_set_nice (ti->nice);
+  while (timer_elapsed (ti->start_time) < SPIN_TICKS)
+    {
+      int64_t cur_time = timer_ticks ();
+      if (cur_time != last_time)
+        ti->count++;
+      last_time = cur_time;
+    }
+}
+
+static void
+interactive_thread (void *ti_)
+{
+  struct thread_info *ti = ti_;
+
+  thread_set_nice (ti->nice);
+  while (timer_elapsed (ti->start_time) < SPIN_TICKS)
+    {
+      timer_sleep (1);
+      ti->count++;
+    }
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my (@ticks);
+foreach (@output) {
+    $ticks[$1] = $2
+      if /^\(sched-fair\) Batch thread (\d) \(nice \d\) received (\d+) ticks\./;
+}
+fail "Missing batch thread results.\n"
+  if !defined $ticks[0] || !defined $ticks[1];
+my ($total) = $ticks[0] + $ticks[1];
+fail "Batch threads received no ticks.\n" if $total == 0;
+my ($share) = $ticks[0] / $total;
+fail sprintf ("Nice 0 thread received %.0f%% of batch ticks, "
+	      . "expected about 75%%.\n", $share * 100)
+  if $share < .65 || $share > .85;
+
+my ($wakeups) = grep (/Interactive thread woke up (\d+) times/, @output);
+fail "Missing interactive thread result.\n" if !defined $wakeups;
+my ($count, $ticks) = $wakeups =~ /woke up (\d+) times in (\d+) ticks/;
+fail "Interactive thread woke up only $count times in $ticks ticks.\n"
+  if $count < $ticks / 2;
+pass;
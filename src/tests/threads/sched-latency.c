@@ -0,0 +1,86 @@
+/* Measures the cost of a scheduling decision as the number of
+   ready threads grows.  For each run, the main thread creates N
+   lower-priority threads spread across the priority range, then
+   repeatedly yields.  Each yield puts the main thread back on the
+   run queue and picks the highest-priority ready thread, which
+   is the main thread again, so the loop exercises exactly one
+   enqueue and one pick per iteration with N other threads
+   waiting.  The ready threads are then allowed to run and exit.
+
+   The number of yields completed per timer tick should stay
+   roughly constant from 10 to 1000 ready threads.  Creating 1000
+   threads needs about 4 MB of kernel pool; with less memory the
+   test reports how many threads it managed to create. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of timer ticks to spend yielding for each run. */
+#define MEASURE_TICKS 50
+
+static void measure (int thread_cnt);
+static thread_func ready_thread;
+
+void
+test_sched_latency (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  measure (10);
+  measure (100);
+  measure (1000);
+}
+
+/* Creates THREAD_CNT ready threads below our priority and
+   reports how many yields complete in MEASURE_TICKS ticks. */
+static void
+measure (int thread_cnt)
+{
+  int64_t start, elapsed;
+  long long yields;
+  int created;
+
+  for (created = 0; created < thread_cnt; created++)
+    {
+      char name[16];
+      int priority = PRI_MIN + 1 + created % (PRI_DEFAULT - PRI_MIN - 1);
+
+      snprintf (name, sizeof name, "ready %d", created);
+      if (thread_create (name, priority, ready_thread, NULL) == TID_ERROR)
+        break;
+    }
+
+  /* Start on a tick boundary. */
+  start = timer_ticks ();
+  while (timer_elapsed (start) == 0)
+    continue;
+
+  start = timer_ticks ();
+  yields = 0;
+  do
+    {
+      thread_yield ();
+      yields++;
+    }
+  while ((elapsed = timer_elapsed (start)) < MEASURE_TICKS);
+
+  msg ("%d ready threads (%d created): %lld yields in %lld ticks, "
+       "%lld ns/yield.", thread_cnt, created, yields, elapsed,
+       elapsed * (1000000000 / TIMER_FREQ) / yields);
+
+  /* Let the ready threads run to completion. */
+  thread_set_priority (PRI_MIN);
+  thread_set_priority (PRI_DEFAULT);
+}
+
+static void
+ready_thread (void *aux UNUSED)
+{
+}
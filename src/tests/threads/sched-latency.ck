@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+foreach my $n (10, 100, 1000) {
+    fail "No result for $n ready threads.\n"
+      if !grep (/^\(sched-latency\) $n ready threads \(\d+ created\):/,
+		@output);
+}
+pass;
@@ -0,0 +1,68 @@
+/* Checks that a slab cache hands out distinct objects in their
+   constructed state, spread over as many slabs as needed, and
+   that freeing every object gives back all but one slab, which
+   is reused by the next allocation. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/slab.h"
+
+#define CTOR_MAGIC 0x600dcafe
+
+struct object 
+  {
+    unsigned magic;             /* Set by the constructor. */
+    size_t idx;                 /* Index in `objects'. */
+    char pad[16];
+  };
+
+static slab_ctor object_ctor;
+static struct slab_cache cache;
+static struct object *objects[1024];
+
+void
+test_slab (void) 
+{
+  size_t obj_cnt, i;
+  long long grow_cnt;
+
+  slab_cache_init (&cache, "test", sizeof (struct object), object_ctor);
+  obj_cnt = 2 * cache.obj_cnt + 1;
+  ASSERT (obj_cnt <= sizeof objects / sizeof *objects);
+
+  for (i = 0; i < obj_cnt; i++)
+    {
+      objects[i] = slab_alloc (&cache);
+      if (objects[i] == NULL)
+        fail ("allocation %zu failed", i);
+      if (objects[i]->magic != CTOR_MAGIC)
+        fail ("object %zu not constructed", i);
+      objects[i]->idx = i;
+    }
+  for (i = 0; i < obj_cnt; i++)
+    if (objects[i]->idx != i)
+      fail ("object %zu overlaps object %zu", i, objects[i]->idx);
+  msg ("Allocated 2 slabs' worth of objects plus one, in %zu slabs.",
+       cache.slab_cnt);
+
+  for (i = 0; i < obj_cnt; i++)
+    slab_free (&cache, objects[i]);
+  msg ("Freed all objects, %zu slab left.", cache.slab_cnt);
+
+  grow_cnt = cache.grow_cnt;
+  objects[0] = slab_alloc (&cache);
+  if (objects[0] == NULL || objects[0]->magic != CTOR_MAGIC)
+    fail ("reallocation failed");
+  if (cache.grow_cnt != grow_cnt)
+    fail ("reallocation created a slab");
+  msg ("Reallocated an object from the remaining slab.");
+  slab_free (&cache, objects[0]);
+}
+
+static void
+object_ctor (void *object_) 
+{
+  struct object *object = object_;
+  object->magic = CTOR_MAGIC;
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab) begin
+(slab) Allocated 2 slabs' worth of objects plus one, in 3 slabs.
+(slab) Freed all objects, 1 slab left.
+(slab) Reallocated an object from the remaining slab.
+(slab) end
+EOF
+pass;
@@ -31,6 +31,7 @@ static const struct test tests[] =
     {"priority-condvar", test_priority_condvar},
     {"deadlock-simple", test_deadlock_simple},
     {"deadlock-nest", test_deadlock_nest},
+    {"deadlock-mlfqs", test_deadlock_mlfqs},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -40,6 +41,13 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"sched-latency", test_sched_latency},
+    {"sched-fair", test_sched_fair},
+    {"thread-create", test_thread_create},
+    {"workqueue", test_workqueue},
+    {"workqueue-fair", test_workqueue},
+    {"workqueue-mlfqs", test_workqueue},
+    {"slab", test_slab},
   };
 
 static const char *test_name;
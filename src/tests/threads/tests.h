@@ -25,6 +25,7 @@ extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
 extern test_func test_deadlock_simple;
 extern test_func test_deadlock_nest;
+extern test_func test_deadlock_mlfqs;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -34,6 +35,11 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_sched_latency;
+extern test_func test_sched_fair;
+extern test_func test_thread_create;
+extern test_func test_workqueue;
+extern test_func test_slab;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,67 @@
+/* Checks that threads can be created and destroyed many more
+   times than the kernel pool could hold at once, that the pages
+   of exited threads are reused, and that each new thread starts
+   out with a clean struct thread even though a reused page is
+   not zeroed.
+
+   The main thread repeatedly creates a higher-priority thread
+   that exits at once.  Each new thread preempts the main thread
+   as soon as it is created, and its page is released before the
+   main thread creates the next one, so every thread should run
+   on the page of the thread before it. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 2000
+
+static thread_func exit_thread;
+
+static int ran_cnt;                     /* Threads that have run. */
+static int page_cnt;                    /* Times a thread ran on a page
+                                           its predecessor did not. */
+static struct thread *last_page;        /* Page of the last thread. */
+
+void
+test_thread_create (void)
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      if (thread_create ("exit", PRI_DEFAULT + 1, exit_thread, NULL)
+          == TID_ERROR)
+        fail ("thread_create failed after %d threads", i);
+      if (ran_cnt != i + 1)
+        fail ("thread %d did not run as soon as it was created", i);
+    }
+  msg ("All %d threads ran.", THREAD_CNT);
+
+  if (page_cnt > 2)
+    fail ("%d threads ran on %d different pages", THREAD_CNT, page_cnt);
+  msg ("Exited threads' pages were reused.");
+}
+
+static void
+exit_thread (void *aux UNUSED)
+{
+  struct thread *t = thread_current ();
+
+  if (t->priority != PRI_DEFAULT + 1 || t->old_priority != PRI_DEFAULT + 1
+      || t->waiting_lock != NULL || !list_empty (&t->held_locks))
+    fail ("thread %d started with stale state", ran_cnt);
+
+  if (t != last_page)
+    page_cnt++;
+  last_page = t;
+  ran_cnt++;
+}
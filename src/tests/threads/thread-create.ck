@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-create) begin
+(thread-create) All 2000 threads ran.
+(thread-create) Exited threads' pages were reused.
+(thread-create) end
+EOF
+pass;
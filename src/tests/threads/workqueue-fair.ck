@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue-fair) begin
+(workqueue-fair) Pushed work a and b.
+(workqueue-fair) Work high ran in kworker/high.
+(workqueue-fair) Pushed work high.
+(workqueue-fair) Work a ran in kworker.
+(workqueue-fair) Work b ran in kworker.
+(workqueue-fair) All work done.
+(workqueue-fair) end
+EOF
+pass;
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue-mlfqs) begin
+(workqueue-mlfqs) Pushed work a and b.
+(workqueue-mlfqs) Work high ran in kworker/high.
+(workqueue-mlfqs) Pushed work high.
+(workqueue-mlfqs) Work a ran in kworker.
+(workqueue-mlfqs) Work b ran in kworker.
+(workqueue-mlfqs) All work done.
+(workqueue-mlfqs) end
+EOF
+pass;
@@ -0,0 +1,67 @@
+/* Checks that work items run in the worker thread of the
+   workqueue they are pushed to, that the high-priority worker
+   preempts us as soon as it has work, and that pushing a work
+   item that is still pending does nothing.
+
+   The workers run in the priority class whatever our class is,
+   so the same checks hold when this test runs under
+   "-sched=fair" (as workqueue-fair) or "-mlfqs" (as
+   workqueue-mlfqs). */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+static work_func report_work;
+static work_func gate_work;
+static struct semaphore done;
+static struct semaphore gate;
+
+void
+test_workqueue (void) 
+{
+  struct work g, a, b, high;
+
+  sema_init (&done, 0);
+  sema_init (&gate, 0);
+  work_init (&g, gate_work, NULL);
+  work_init (&a, report_work, "a");
+  work_init (&b, report_work, "b");
+  work_init (&high, report_work, "high");
+
+  /* Hold the normal worker in G until we open the gate, so that
+     A and B stay pending however the scheduler interleaves us
+     with it. */
+  if (!workqueue_push (WQ_NORMAL, &g)
+      || !workqueue_push (WQ_NORMAL, &a) || !workqueue_push (WQ_NORMAL, &b))
+    fail ("pushing idle work failed");
+  if (workqueue_push (WQ_NORMAL, &a))
+    fail ("pushing pending work succeeded");
+  msg ("Pushed work a and b.");
+
+  /* The high-priority worker runs at once. */
+  workqueue_push (WQ_HIGH, &high);
+  msg ("Pushed work high.");
+  sema_down (&done);
+
+  sema_up (&gate);
+  sema_down (&done);
+  sema_down (&done);
+  msg ("All work done.");
+}
+
+static void
+gate_work (void *aux UNUSED) 
+{
+  sema_down (&gate);
+}
+
+static void
+report_work (void *name) 
+{
+  msg ("Work %s ran in %s.", (const char *) name, thread_name ());
+  sema_up (&done);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) Pushed work a and b.
+(workqueue) Work high ran in kworker/high.
+(workqueue) Pushed work high.
+(workqueue) Work a ran in kworker.
+(workqueue) Work b ran in kworker.
+(workqueue) All work done.
+(workqueue) end
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Page-fault throughput benchmark.  Touches each page of a
+   2 MB buffer, which faults it in, then writes and checks every
+   page several times over, so that the run time is dominated by
+   page faults and by tearing down the process's mappings at
+   exit.  Compare the "Timer" and "Exception" lines that the
+   kernel prints at shutdown across kernels to compare the cost
+   of a page fault. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE_SIZE 4096
+#define ROUNDS 4
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+  int round;
+
+  msg ("touch each page");
+  for (i = 0; i < SIZE; i += PAGE_SIZE)
+    buf[i] = 1;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      msg ("round %d", round);
+      for (i = 0; i < SIZE; i += PAGE_SIZE)
+        buf[i + round] = i / PAGE_SIZE + round;
+      for (i = 0; i < SIZE; i += PAGE_SIZE)
+        if (buf[i + round] != (char) (i / PAGE_SIZE + round))
+          fail ("byte %zu is %d, expected %d", i + round, buf[i + round],
+                (char) (i / PAGE_SIZE + round));
+    }
+}
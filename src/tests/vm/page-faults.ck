@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-faults) begin
+(page-faults) touch each page
+(page-faults) round 0
+(page-faults) round 1
+(page-faults) round 2
+(page-faults) round 3
+(page-faults) end
+EOF
+pass;
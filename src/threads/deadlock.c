@@ -1,120 +1,70 @@
 #include "threads/deadlock.h"
+#include <stdio.h>
 #include "threads/interrupt.h"
-#include "threads/malloc.h"
 #include "threads/synch.h"
 
-bool
-someone_not_visited (int *visited, int size)
-{
-  int i;
-  for (i = 0; i < size; i++)
-      if (visited[i] == 0)
-         return true;
-  return false;
-} 
-
-bool
-detect_cycles (int **graph, int order)
-{
-  int *visited = (int*) calloc (order, sizeof (int));
-  int i, j, working_node;
-
-  while (someone_not_visited (visited, order))
-    {
-      for (i = 0; i < order; i++)
-        {
-          if (visited[i]) continue;
-
-          for (j = 0; j < order; j++)
-              if (graph[j][i] != 0) break;
+/* See deadlock.h. */
+bool deadlock_detection = true;
 
-          if (j == order)
-           {
-             working_node = i;
-             break;
-           }
-        }
-      if (i == order)
-       {
-         free (visited);
-         return true;
-       }
-
-      visited[working_node] = 1;
-      for (i = 0; i < order; i++)
-          graph[working_node][i] = 0;
-    }
+/* Statistics. */
+static long long check_cnt;     /* # of calls that walked a chain. */
+static long long found_cnt;     /* # of deadlocks found. */
+static long long step_cnt;      /* # of wait-for edges followed. */
+static int max_steps;           /* Longest chain followed. */
 
-  free (visited);
-  return false;
-}       
+/* Returns true if thread W waiting for a lock held by thread H
+   would close a cycle in the wait-for graph, false otherwise.
 
+   A thread waits on at most one lock at a time, so every thread
+   has at most one outgoing wait-for edge, from itself to the
+   holder of its `waiting_lock'.  A new edge W -> H therefore
+   closes a cycle exactly when W is reachable from H by following
+   those edges, and finding out takes time proportional to the
+   length of H's chain and allocates nothing. */
 bool
 detect_deadlocks (struct thread *h, struct thread *w)
 {
-  int i,j;
-  int size = list_size (&thread_list);
+  enum intr_level old_level;
+  struct thread *t;
+  bool deadlock = false;
+  int steps = 0;
 
-  if ((size <= 1) || (list_size (&lock_list) <= 1))
+  if (!deadlock_detection || h == NULL)
      return false;
 
-  enum intr_level old_level = intr_disable ();
+  old_level = intr_disable ();
 
-  int **wfg = (int**) calloc (size, sizeof (int*));
-  for (i = 0; i < size; i++)
-      *(wfg+i) = (int*) calloc (size, sizeof (int));
-  
-  struct list_elem *e, *f;
-
-  for (e = list_begin (&lock_list); e != list_end (&lock_list); 
-       e = list_next (e))
+  for (t = h; t != NULL; 
+       t = t->waiting_lock != NULL ? t->waiting_lock->holder : NULL)
     {
-      struct lock *l = list_entry (e, struct lock_elem, elem)->lock;
-      if (l->holder == NULL)
-         continue;
-      i = get_id (l->holder);
-      for (f = list_begin (&l->semaphore.waiters);
-           f != list_end (&l->semaphore.waiters);
-           f = list_next (f))
-        {
-          j = get_id (list_entry (f, struct thread, elem));
-          wfg[j][i] = 1;
-        }
+      steps++;
+      if (t == w)
+       {
+         deadlock = true;
+         break;
+       }
     }
 
-  i = get_id (h);
-  j = get_id (w);
-  wfg[j][i] = 1;
-
-/*  for (i=0;i<size;i++){
-  for (j=0;j<size;j++)
-      printf ("%d ",wfg[i][j]);
-  printf ("\n");
-  }
-*/
-  if (detect_cycles (wfg, size))
-   {
-     free (wfg);
-     intr_set_level (old_level);
-     return true;
-   }
+  check_cnt++;
+  step_cnt += steps;
+  if (steps > max_steps)
+     max_steps = steps;
+  if (deadlock)
+     found_cnt++;
 
-  free (wfg);
   intr_set_level (old_level);
-  return false;
+  return deadlock;
 }
 
-int get_id (struct thread *t)
+/* Prints deadlock detection statistics. */
+void
+deadlock_print_stats (void)
 {
-  struct list_elem *e;
-  int count = 0;
-  for (e = list_begin (&thread_list); e != list_end (&thread_list); 
-       e = list_next (e))
+  if (!deadlock_detection)
     {
-      struct thread *u = list_entry (e, struct thread_elem, elem)->t;
-      if (t == u)
-         return count;
-      count++;
+      printf ("Deadlock: detection disabled\n");
+      return;
     }
-  return -1;
+  printf ("Deadlock: %lld checks, %lld deadlocks, %lld edges followed "
+          "(longest chain %d)\n", check_cnt, found_cnt, step_cnt, max_steps);
 }
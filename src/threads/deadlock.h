@@ -1,7 +1,15 @@
+#ifndef THREADS_DEADLOCK_H
+#define THREADS_DEADLOCK_H
+
 #include <stdbool.h>
 #include "threads/thread.h"
 
-bool someone_not_visited (int *, int);
-bool detect_cycles (int **, int);
+/* If true (default), lock_acquire() refuses to wait for a lock
+   when waiting would deadlock.  If false, detection is skipped.
+   Controlled by kernel command-line option "-no-deadlock". */
+extern bool deadlock_detection;
+
 bool detect_deadlocks (struct thread *, struct thread *);
-int get_id (struct thread *);
+void deadlock_print_stats (void);
+
+#endif /* threads/deadlock.h */
@@ -13,6 +13,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/deadlock.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -21,6 +22,9 @@
 #include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/shell.h"
+#include "threads/slab.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -90,6 +94,7 @@ main (void)
   /* Initialize memory system. */
   palloc_init ();
   malloc_init ();
+  slab_init ();
   paging_init ();
 
   /* Segmentation. */
@@ -100,6 +105,7 @@ main (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  softirq_init ();
   timer_init ();
   kbd_init ();
   input_init ();
@@ -110,6 +116,7 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -259,10 +266,30 @@ parse_options (char **argv)
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
-        thread_mlfqs = true;
+        thread_default_class = &sched_mlfqs;
+      else if (!strcmp (name, "-sched"))
+        {
+          thread_default_class = sched_find (value);
+          if (thread_default_class == NULL)
+            PANIC ("unknown scheduling class `%s'", value);
+        }
+      else if (!strcmp (name, "-no-deadlock"))
+        deadlock_detection = false;
+      else if (!strcmp (name, "-no-lapic"))
+        lapic_enabled = false;
+      else if (!strcmp (name, "-trace"))
+        trace_start ();
+      else if (!strcmp (name, "-irqsoff"))
+        irqsoff_start_tracing ();
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-dirty-ratio"))
+        frame_dirty_ratio = atoi (value);
+      else if (!strcmp (name, "-clean-ahead"))
+        frame_clean_ahead = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -369,8 +396,19 @@ usage (void)
           "  -f                 Format file system disk during startup.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -sched=CLASS       Schedule with CLASS: prio, mlfqs, or fair.\n"
+          "  -no-deadlock       Skip deadlock detection in lock_acquire().\n"
+          "  -no-lapic          Tick with the PIT even if there is a local APIC.\n"
+          "  -trace             Record scheduler events from boot.\n"
+          "  -irqsoff           Time interrupts-off stretches from boot.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -dirty-ratio=PCT   Clean pages ahead of eviction once PCT%% of\n"
+          "                     them are dirty (default 10).\n"
+          "  -clean-ahead=COUNT Look COUNT frames ahead of eviction for\n"
+          "                     dirty pages to clean (default 32).\n"
 #endif
           );
   power_off ();
@@ -406,7 +444,13 @@ static void
 print_stats (void) 
 {
   timer_print_stats ();
+  irqsoff_print_stats ();
   thread_print_stats ();
+  workqueue_print_stats ();
+  deadlock_print_stats ();
+  palloc_print_stats ();
+  malloc_stats ();
+  slab_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
 #endif
@@ -415,4 +459,8 @@ print_stats (void)
 #ifdef USERPROG
   exception_print_stats ();
 #endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+#endif
 }
@@ -4,10 +4,14 @@
 #include <stdint.h>
 #include <stdio.h>
 #include "threads/flags.h"
+#include "threads/init.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/workqueue.h"
 #include "devices/timer.h"
 
 /* Number of x86 interrupts. */
@@ -31,14 +35,55 @@ static const char *intr_names[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
+   interrupt returns.
+
+   The softirq pass that ends an external interrupt runs with
+   interrupts back on, so that the work handlers defer to it does
+   not hold off other interrupts.  It counts as interrupt context
+   too, and it never nests: an interrupt that arrives during the
+   pass leaves its work, and any yield it asks for, to the pass
+   it interrupted. */
 static bool in_external_intr;   /* Are we processing an external interrupt? */
+static bool in_softirq;         /* Are we in the softirq pass? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Interrupts delivered by the local APIC rather than the PICs.
+   These are handled like external interrupts, except that they
+   are acknowledged at the local APIC. */
+static bool intr_local[INTR_CNT];
+
+/* Interrupts-off latency tracer.  While it runs, it times each
+   stretch during which interrupts are off, from the code that
+   turned them off, or the interrupt gate that did, to the code
+   that turned them back on, or the return from the interrupt.
+   Sites are code addresses, to be translated with the
+   `backtrace' utility. */
+static bool irqsoff_enabled;            /* Tracer running? */
+static bool irqsoff_open;               /* Timing a stretch now? */
+static uint64_t irqsoff_start;          /* timer_cycles() at its start. */
+static const void *irqsoff_start_site;  /* Where it started. */
+static long long irqsoff_cnt;           /* Stretches timed. */
+static uint64_t irqsoff_total;          /* Their total length in ns. */
+static uint64_t irqsoff_max;            /* Longest stretch in ns. */
+static const void *irqsoff_max_off;     /* Where it started. */
+static const void *irqsoff_max_on;      /* Where it ended. */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
 
+/* Local APIC helpers. */
+static void lapic_init (void);
+
+/* Kernel virtual address at which the local APIC's registers
+   are mapped, just below the top of the address space, or a null
+   pointer if there is no usable local APIC. */
+#define LAPIC_VADDR ((void *) 0xfffff000)
+static volatile uint32_t *lapic;
+
+/* See interrupt.h. */
+bool lapic_enabled = true;
+
 /* Interrupt Descriptor Table helpers. */
 static uint64_t make_intr_gate (void (*) (void), int dpl);
 static uint64_t make_trap_gate (void (*) (void), int dpl);
@@ -62,20 +107,50 @@ intr_get_level (void)
   return flags & FLAG_IF ? INTR_ON : INTR_OFF;
 }
 
-/* Enables or disables interrupts as specified by LEVEL and
-   returns the previous interrupt status. */
-enum intr_level
-intr_set_level (enum intr_level level) 
+/* Starts timing a stretch with interrupts off, which SITE
+   began.  Interrupts must be off. */
+static inline void
+irqsoff_begin (const void *site)
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  if (__builtin_expect (irqsoff_enabled, 0))
+    {
+      irqsoff_open = true;
+      irqsoff_start = timer_cycles ();
+      irqsoff_start_site = site;
+    }
 }
 
-/* Enables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_enable (void) 
+/* Finishes timing the current stretch with interrupts off, if
+   any, which SITE is ending.  Interrupts must be off. */
+static inline void
+irqsoff_end (const void *site)
+{
+  if (__builtin_expect (irqsoff_open, 0))
+    {
+      uint64_t ns = timer_cycles_to_ns (timer_cycles () - irqsoff_start);
+
+      irqsoff_open = false;
+      irqsoff_cnt++;
+      irqsoff_total += ns;
+      if (ns > irqsoff_max)
+        {
+          irqsoff_max = ns;
+          irqsoff_max_off = irqsoff_start_site;
+          irqsoff_max_on = site;
+        }
+    }
+}
+
+/* Enables interrupts on behalf of the code at SITE and returns
+   the previous interrupt status. */
+static inline enum intr_level
+enable (const void *site)
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  ASSERT (!in_external_intr);
+
+  if (old_level == INTR_OFF)
+    irqsoff_end (site);
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -86,9 +161,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_disable (void) 
+/* Disables interrupts on behalf of the code at SITE and returns
+   the previous interrupt status. */
+static inline enum intr_level
+disable (const void *site)
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -97,8 +173,87 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (old_level == INTR_ON)
+    irqsoff_begin (site);
+
   return old_level;
 }
+
+/* Enables or disables interrupts as specified by LEVEL and
+   returns the previous interrupt status. */
+enum intr_level
+intr_set_level (enum intr_level level) 
+{
+  const void *site = __builtin_return_address (0);
+
+  return level == INTR_ON ? enable (site) : disable (site);
+}
+
+/* Enables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_enable (void) 
+{
+  return enable (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_disable (void) 
+{
+  return disable (__builtin_return_address (0));
+}
+
+/* Starts the interrupts-off latency tracer, discarding the
+   results of any earlier run. */
+void
+irqsoff_start_tracing (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  irqsoff_cnt = 0;
+  irqsoff_total = irqsoff_max = 0;
+  irqsoff_max_off = irqsoff_max_on = NULL;
+  irqsoff_open = false;
+  irqsoff_enabled = true;
+  intr_set_level (old_level);
+}
+
+/* Stops the interrupts-off latency tracer, keeping its
+   results. */
+void
+irqsoff_stop_tracing (void)
+{
+  enum intr_level old_level = intr_disable ();
+
+  irqsoff_enabled = irqsoff_open = false;
+  intr_set_level (old_level);
+}
+
+/* Prints the results of the interrupts-off latency tracer, if it
+   has run. */
+void
+irqsoff_print_stats (void)
+{
+  enum intr_level old_level;
+  long long cnt;
+  uint64_t total, max;
+  const void *off, *on;
+
+  old_level = intr_disable ();
+  cnt = irqsoff_cnt;
+  total = irqsoff_total;
+  max = irqsoff_max;
+  off = irqsoff_max_off;
+  on = irqsoff_max_on;
+  intr_set_level (old_level);
+
+  if (cnt == 0)
+    return;
+  printf ("Interrupts off: %lld times, %"PRIu64" us in all, "
+          "longest %"PRIu64" us\n", cnt, total / 1000, max / 1000);
+  printf ("Interrupts off: longest turned off at %p, back on at %p\n",
+          off, on);
+}
 
 /* Initializes the interrupt system. */
 void
@@ -107,8 +262,9 @@ intr_init (void)
   uint64_t idtr_operand;
   int i;
 
-  /* Initialize interrupt controller. */
+  /* Initialize interrupt controllers. */
   pic_init ();
+  lapic_init ();
 
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
@@ -193,12 +349,26 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Registers interrupt VEC_NO, which is delivered by the local
+   APIC, to invoke HANDLER, which is named NAME for debugging
+   purposes.  The handler executes as an external interrupt, with
+   interrupts disabled. */
+void
+intr_register_local (uint8_t vec_no, intr_handler_func *handler,
+                     const char *name)
+{
+  ASSERT (vec_no >= 0x30);
+  ASSERT (lapic_available ());
+  register_handler (vec_no, 0, INTR_OFF, handler, name);
+  intr_local[vec_no] = true;
+}
+
+/* Returns true during processing of an external interrupt,
+   including its softirq pass, and false at all other times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_softirq;
 }
 
 /* During processing of an external interrupt, directs the
@@ -268,6 +438,80 @@ pic_end_of_interrupt (int irq)
     outb (0xa0, 0x20);
 }
 
+/* Local APIC. */
+
+/* Does nothing.  The local APIC raises a spurious interrupt when
+   it retracts an interrupt it was about to deliver; these need
+   no acknowledgment. */
+static void
+lapic_spurious (struct intr_frame *f UNUSED)
+{
+}
+
+/* Detects the local APIC, maps its registers into the kernel
+   address space, and enables it in "virtual wire" mode, so that
+   interrupts from the PICs keep arriving through LINT0.  Does
+   nothing if the CPU has no local APIC or "-no-lapic" was
+   given.  See [IA32-v3a] 8.4 "Local APIC". */
+static void
+lapic_init (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  uint32_t base_lo, base_hi;
+  uint32_t *pt;
+
+  if (!lapic_enabled)
+    return;
+
+  /* CPUID leaf 1, EDX bit 9: APIC on chip. */
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  if (!(edx & (1 << 9)))
+    return;
+
+  /* IA32_APIC_BASE MSR gives the registers' physical address. */
+  asm volatile ("rdmsr" : "=a" (base_lo), "=d" (base_hi) : "c" (0x1b));
+
+  /* Map the register page uncached at LAPIC_VADDR.  User page
+     directories copy the kernel's, so they pick this up too. */
+  ASSERT (base_page_dir[pd_no (LAPIC_VADDR)] == 0);
+  pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  base_page_dir[pd_no (LAPIC_VADDR)] = pde_create (pt);
+  pt[pt_no (LAPIC_VADDR)] = ((base_lo & PTE_ADDR) 
+                             | PTE_PCD | PTE_PWT | PTE_W | PTE_P);
+  asm volatile ("movl %%cr3, %%eax; movl %%eax, %%cr3" : : : "eax", "memory");
+  lapic = LAPIC_VADDR;
+
+  intr_register_int (LAPIC_SPURIOUS_VEC, 0, INTR_OFF, lapic_spurious,
+                     "LAPIC Spurious");
+  lapic_write (LAPIC_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VEC);
+  lapic_write (LAPIC_LVT_LINT0, 0x700);  /* ExtINT: 8259A PIC. */
+  lapic_write (LAPIC_LVT_LINT1, 0x400);  /* NMI. */
+  lapic_write (LAPIC_SVR, 0x100 | LAPIC_SPURIOUS_VEC); /* Enable. */
+}
+
+/* Returns true if the local APIC is present and enabled. */
+bool
+lapic_available (void)
+{
+  return lapic != NULL;
+}
+
+/* Returns the value of local APIC register REG. */
+uint32_t
+lapic_read (uint32_t reg)
+{
+  ASSERT (lapic != NULL);
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Sets local APIC register REG to VALUE. */
+void
+lapic_write (uint32_t reg, uint32_t value)
+{
+  ASSERT (lapic != NULL);
+  lapic[reg / sizeof *lapic] = value;
+}
+
 /* Creates an gate that invokes FUNCTION.
 
    The gate has descriptor privilege level DPL, meaning that it
@@ -339,24 +583,32 @@ void
 intr_handler (struct intr_frame *frame) 
 {
   bool external;
-  intr_handler_func *handler;
+  intr_handler_func *handler = intr_handlers[frame->vec_no];
+
+  /* An interrupt gate turned off interrupts that were on. */
+  if ((frame->eflags & FLAG_IF) && intr_get_level () == INTR_OFF)
+    irqsoff_begin (handler);
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  external = ((frame->vec_no >= 0x20 && frame->vec_no < 0x30)
+              || intr_local[frame->vec_no]);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_softirq)
+        yield_on_return = false;
+
+      /* Restart the timer tick if it was stopped for idle. */
+      timer_idle_exit ();
     }
 
   /* Invoke the interrupt's handler. */
-  handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
      handler (frame);
   else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
@@ -379,12 +631,29 @@ intr_handler (struct intr_frame *frame)
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
+      if (intr_local[frame->vec_no])
+        lapic_write (LAPIC_EOI, 0);
+      else
+        pic_end_of_interrupt (frame->vec_no); 
+
       in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
-        thread_yield (); 
+      /* Run the work the handler deferred, unless we interrupted
+         a softirq pass, which will run it instead. */
+      if (!in_softirq)
+        {
+          in_softirq = true;
+          softirq_run ();
+          in_softirq = false;
+
+          if (yield_on_return) 
+            thread_yield (); 
+        }
     }
+
+  /* Returning from the interrupt turns interrupts back on. */
+  if ((frame->eflags & FLAG_IF) && intr_get_level () == INTR_OFF)
+    irqsoff_end (handler);
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
@@ -15,6 +15,10 @@ enum intr_level intr_get_level (void);
 enum intr_level intr_set_level (enum intr_level);
 enum intr_level intr_enable (void);
 enum intr_level intr_disable (void);
+
+void irqsoff_start_tracing (void);
+void irqsoff_stop_tracing (void);
+void irqsoff_print_stats (void);
 
 /* Interrupt stack frame. */
 struct intr_frame
@@ -67,4 +71,30 @@ void intr_yield_on_return (void);
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
 
+/* Local APIC.  See [IA32-v3a] chapter 8 "Advanced Programmable
+   Interrupt Controller (APIC)". */
+#define LAPIC_EOI       0x0b0   /* End-of-interrupt register. */
+#define LAPIC_SVR       0x0f0   /* Spurious interrupt vector register. */
+#define LAPIC_LVT_TIMER 0x320   /* LVT timer register. */
+#define LAPIC_LVT_LINT0 0x350   /* LVT LINT0 register. */
+#define LAPIC_LVT_LINT1 0x360   /* LVT LINT1 register. */
+#define LAPIC_TIMER_INIT 0x380  /* Timer initial count register. */
+#define LAPIC_TIMER_CUR 0x390   /* Timer current count register. */
+#define LAPIC_TIMER_DIV 0x3e0   /* Timer divide configuration register. */
+
+#define LAPIC_LVT_MASKED 0x10000 /* LVT entry: interrupt masked. */
+
+/* Interrupt vectors delivered by the local APIC. */
+#define LAPIC_TIMER_VEC 0x30    /* Local APIC timer. */
+#define LAPIC_SPURIOUS_VEC 0xff /* Spurious interrupts. */
+
+/* If false, the local APIC is left alone even if the CPU has one.
+   Controlled by kernel command-line option "-no-lapic". */
+extern bool lapic_enabled;
+
+bool lapic_available (void);
+uint32_t lapic_read (uint32_t reg);
+void lapic_write (uint32_t reg, uint32_t value);
+void intr_register_local (uint8_t vec, intr_handler_func *, const char *name);
+
 #endif /* threads/interrupt.h */
@@ -5,17 +5,18 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to the
+   nearest size class and assigned to the "descriptor" that
+   manages blocks of that size.  The descriptor keeps a list of
+   free blocks.  If the free list is nonempty, one of its blocks
+   is used to satisfy the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
@@ -32,7 +33,21 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Size classes are spaced about 1/8 of a power of 2 apart, so
+   that rounding a request up wastes at most about 12.5% of its
+   block, except that they are 8 bytes apart below 64 bytes.
+   Each class is then widened to the largest multiple of 8 bytes
+   that fits the same number of blocks into an arena, because
+   the rest of the arena would be wasted anyway, and classes that
+   end up the same size are merged.  For classes of more than
+   about 500 bytes, the number of blocks per arena, rather than
+   the 12.5% spacing, decides the spacing.
+
+   realloc() keeps a block where it is if the new size still
+   fits and the block would be less than half used; otherwise it
+   moves the block to a better-fitting class. */
 
 /* Descriptor. */
 struct desc
@@ -41,6 +56,12 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+
+    /* Statistics. */
+    size_t arena_cnt;           /* Number of arenas. */
+    size_t in_use;              /* Number of blocks in use. */
+    long long alloc_cnt;        /* # of blocks allocated. */
+    long long req_bytes;        /* Bytes requested by those allocations. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -60,10 +81,28 @@ struct block
     struct list_elem free_elem; /* Free list element. */
   };
 
+/* Bytes available for blocks in an arena. */
+#define ARENA_BYTES (PGSIZE - sizeof (struct arena))
+
+/* Largest block size handled by a descriptor: two blocks must
+   fit in an arena. */
+#define MAX_BLOCK_SIZE ROUND_DOWN (ARENA_BYTES / 2, 8)
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[40];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Maps a request of SIZE bytes, up to MAX_BLOCK_SIZE, to the
+   index in descs[] of the smallest descriptor that satisfies it,
+   as size_to_desc[DIV_ROUND_UP (SIZE, 8)]. */
+static uint8_t size_to_desc[MAX_BLOCK_SIZE / 8 + 1];
+
+/* Big block statistics. */
+static size_t big_pages;        /* Pages in big blocks in use. */
+static long long big_cnt;       /* # of big blocks allocated. */
+static long long big_bytes;     /* Bytes in those allocations. */
+static long long big_req_bytes; /* Bytes requested by those allocations. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -71,16 +110,37 @@ static struct block *arena_to_block (struct arena *, size_t idx);
 void
 malloc_init (void) 
 {
-  size_t block_size;
+  size_t size, step, i;
 
-  for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+  for (size = 16; size <= MAX_BLOCK_SIZE; size += step)
     {
-      struct desc *d = &descs[desc_cnt++];
+      size_t blocks_per_arena = ARENA_BYTES / size;
+      size_t block_size = ROUND_DOWN (ARENA_BYTES / blocks_per_arena, 8);
+      struct desc *d;
+
+      /* The next class is 1/8 of the largest power of 2 not
+         greater than SIZE away, but at least 8 bytes. */
+      for (step = 8; step * 16 <= size; step *= 2)
+        continue;
+
+      if (desc_cnt > 0 && descs[desc_cnt - 1].block_size == block_size)
+        continue;
+      d = &descs[desc_cnt++];
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->blocks_per_arena = blocks_per_arena;
       list_init (&d->free_list);
       lock_init (&d->lock);
+      d->arena_cnt = d->in_use = 0;
+      d->alloc_cnt = d->req_bytes = 0;
+    }
+  ASSERT (descs[desc_cnt - 1].block_size == MAX_BLOCK_SIZE);
+
+  for (i = 0, size = 0; size <= MAX_BLOCK_SIZE; size += 8)
+    {
+      while (descs[i].block_size < size)
+        i++;
+      size_to_desc[size / 8] = i;
     }
 }
 
@@ -97,20 +157,24 @@ malloc (size_t size)
   if (size == 0)
     return NULL;
 
-  /* Find the smallest descriptor that satisfies a SIZE-byte
-     request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  if (size > MAX_BLOCK_SIZE) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+      enum intr_level old_level;
+
       a = palloc_get_multiple (0, page_cnt);
       if (a == NULL)
         return NULL;
 
+      old_level = intr_disable ();
+      big_pages += page_cnt;
+      big_cnt++;
+      big_bytes += PGSIZE * page_cnt;
+      big_req_bytes += size;
+      intr_set_level (old_level);
+
       /* Initialize the arena to indicate a big block of PAGE_CNT
          pages, and return it. */
       a->magic = ARENA_MAGIC;
@@ -119,6 +183,11 @@ malloc (size_t size)
       return a + 1;
     }
 
+  /* Find the smallest descriptor that satisfies a SIZE-byte
+     request. */
+  d = &descs[size_to_desc[DIV_ROUND_UP (size, 8)]];
+  ASSERT (d->block_size >= size);
+
   if (!lock_acquire (&d->lock))
      return NULL;
 
@@ -139,6 +208,7 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = d;
       a->free_cnt = d->blocks_per_arena;
+      d->arena_cnt++;
       for (i = 0; i < d->blocks_per_arena; i++) 
         {
           struct block *b = arena_to_block (a, i);
@@ -150,6 +220,9 @@ malloc (size_t size)
   b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
   a = block_to_arena (b);
   a->free_cnt--;
+  d->in_use++;
+  d->alloc_cnt++;
+  d->req_bytes += size;
   lock_release (&d->lock);
   return b;
 }
@@ -186,6 +259,43 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Tries to resize BLOCK to NEW_SIZE bytes without moving it.
+   Returns true if successful, false if BLOCK must move. */
+static bool
+resize_in_place (void *block, size_t new_size) 
+{
+  struct arena *a = block_to_arena (block);
+  struct desc *d = a->desc;
+
+  if (d != NULL)
+    {
+      /* Keep a normal block if NEW_SIZE fits and uses more than
+         half of it, or if no smaller class would do. */
+      return (new_size <= d->block_size
+              && (new_size > d->block_size / 2 || d == descs));
+    }
+  else 
+    {
+      /* Keep a big block if NEW_SIZE still needs a big block and
+         fits in its pages, freeing any pages no longer needed. */
+      size_t page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+      enum intr_level old_level;
+
+      if (new_size <= MAX_BLOCK_SIZE || page_cnt > a->free_cnt)
+        return false;
+      if (page_cnt < a->free_cnt)
+        {
+          palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                                a->free_cnt - page_cnt);
+          old_level = intr_disable ();
+          big_pages -= a->free_cnt - page_cnt;
+          intr_set_level (old_level);
+          a->free_cnt = page_cnt;
+        }
+      return true;
+    }
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -200,6 +310,8 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    return old_block;
   else 
     {
       void *new_block = malloc (new_size);
@@ -210,10 +322,47 @@ realloc (void *old_block, size_t new_size)
           memcpy (new_block, old_block, min_size);
           free (old_block);
         }
+      else if (old_block != NULL && new_size <= block_size (old_block))
+        {
+          /* We wanted to shrink OLD_BLOCK into a smaller class,
+             but there was no memory for it.  Keep it instead. */
+          return old_block;
+        }
       return new_block;
     }
 }
 
+/* Prints the number of arenas and blocks in use for each size
+   class, and the internal fragmentation of all allocations made
+   so far, that is, the share of the bytes handed out that the
+   requests did not ask for. */
+void
+malloc_stats (void) 
+{
+  enum intr_level old_level;
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      long long bytes;
+
+      if (d->alloc_cnt == 0)
+        continue;
+      bytes = d->alloc_cnt * d->block_size;
+      printf ("Malloc: %4zu-byte blocks: %zu arenas, %zu blocks in use, "
+              "%lld allocated, %lld%% wasted\n",
+              d->block_size, d->arena_cnt, d->in_use, d->alloc_cnt,
+              (bytes - d->req_bytes) * 100 / bytes);
+    }
+
+  old_level = intr_disable ();
+  if (big_cnt > 0) 
+    printf ("Malloc: big blocks: %zu pages in use, "
+            "%lld allocated, %lld%% wasted\n",
+            big_pages, big_cnt, (big_bytes - big_req_bytes) * 100 / big_bytes);
+  intr_set_level (old_level);
+}
+
 /* Frees block P, which must have been previously allocated with
    malloc(), calloc(), or realloc(). */
 void
@@ -252,13 +401,18 @@ free (void *p)
                   list_remove (&b->free_elem);
                 }
               palloc_free_page (a);
+              d->arena_cnt--;
             }
 
+          d->in_use--;
           lock_release (&d->lock);
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          enum intr_level old_level = intr_disable ();
+          big_pages -= a->free_cnt;
+          intr_set_level (old_level);
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
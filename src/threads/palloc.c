@@ -2,15 +2,17 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -22,27 +24,138 @@
    that the kernel needs to have memory for its own operations
    even if user processes are swapping like mad.
 
-   By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   At boot, half of system RAM is given to the kernel pool and
+   half to the user pool, but the boundary moves with demand.
+   Both pools index the same range of pages, and user_map records
+   which pool owns each page.  When a pool cannot satisfy a
+   request, it borrows free pages from the other pool, preferably
+   MIGRATE_CNT at a time, as long as the other pool keeps at
+   least its minimum size and 1/LOW_WATER_DIV of its pages free.
+   The kernel pool's minimum is a quarter of RAM, the user pool's
+   an eighth, and the user pool never grows beyond
+   user_page_limit.  Pages stay with the pool that borrowed them
+   until the other pool needs them back, or until they are freed
+   while the borrower has plenty of free pages, when they go back
+   to the pool that owned them at boot.  Each pool's used_map
+   marks the pages owned by the other pool as in use, and its
+   order_map never shows them as free, so a pool's buddy merges
+   never cross into the other pool's pages.
+
+   Each pool is a binary buddy allocator.  Its free memory is
+   kept as blocks of 2**ORDER pages, aligned to their size within
+   the pool, on one free list per order.  A request for N pages
+   takes the smallest free block of at least N pages, splitting
+   it in halves as needed, and gives back the pages beyond N.
+   Freed pages are merged with their free buddies into ever
+   larger blocks.  Both take time logarithmic in the pool size,
+   plus time linear in N to keep the used_map up to date.
+
+   The pools are protected by disabling interrupts rather than by
+   a lock, because thread pages are freed in schedule_tail(),
+   which must not sleep.
+
+   Each pool also keeps a short list of pages that are allocated
+   from its buddy allocator but already zeroed, so that most
+   single-page PAL_ZERO requests cost only a list pop.  The idle
+   thread fills the list, up to ZEROED_MAX pages, by calling
+   palloc_prezero().  The pages go back to the buddy allocator if
+   a request cannot be satisfied otherwise. */
+
+/* Most pre-zeroed pages to keep in each pool. */
+#define ZEROED_MAX 32
+
+/* Preferred number of pages to move between pools at once. */
+#define MIGRATE_CNT 16
+
+/* A pool lends pages only while more than 1/LOW_WATER_DIV of
+   its pages are free. */
+#define LOW_WATER_DIV 16
+
+/* Number of pool balance changes to remember. */
+#define BALANCE_CNT 16
+
+/* Number of block orders: blocks have 1 to 2**(ORDER_CNT - 1)
+   pages. */
+#define ORDER_CNT 16
+
+/* Marks a page that does not begin a free block in order_map. */
+#define NOT_FREE 0xff
+
+/* A free block, overlaid on its first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free list. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    const char *name;                   /* Name, for statistics. */
+    struct bitmap *used_map;            /* Pages in use or not owned. */
+    uint8_t *order_map;                 /* Order of each free block. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages indexed. */
+    size_t owned_cnt;                   /* Number of pages owned. */
+    size_t min_cnt;                     /* Fewest pages to own. */
+    size_t max_cnt;                     /* Most pages to own. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct list free[ORDER_CNT];        /* Free blocks, by order. */
+    struct list zeroed;                 /* Pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pre-zeroed pages. */
+
+    /* Statistics. */
+    long long alloc_cnt;                /* # of successful requests. */
+    long long fail_cnt;                 /* # of failed requests. */
+    long long split_cnt;                /* # of blocks split. */
+    long long merge_cnt;                /* # of buddies merged. */
+    long long zero_hits;                /* # of PAL_ZERO pages pre-zeroed. */
+    long long zero_misses;              /* # of PAL_ZERO pages zeroed on
+                                           request. */
+    long long borrowed_cnt;             /* # of pages borrowed. */
+    long long lent_cnt;                 /* # of pages lent. */
+    long long returned_cnt;             /* # of borrowed pages returned. */
   };
 
+/* Pre-zeroing statistics. */
+static long long prezero_cnt;           /* # of pages zeroed when idle. */
+static uint64_t prezero_ns;             /* Time spent doing so. */
+
 /* Two pools: one for kernel data, one for user pages. */
 struct pool kernel_pool, user_pool;
 
+/* Pages owned by the user pool, rather than the kernel pool. */
+static struct bitmap *user_map;
+
+/* Index of the first page given to the user pool at boot.  The
+   kernel pool's pages start out below it, the user pool's at or
+   above it. */
+static size_t user_start;
+
+/* Size of the user pool after each of the last BALANCE_CNT
+   moves of pages between the pools. */
+struct balance
+  {
+    int64_t ticks;                      /* When the move happened. */
+    size_t user_cnt;                    /* Pages owned by user pool. */
+  };
+static struct balance balance[BALANCE_CNT];
+static unsigned balance_cnt;            /* Number of moves so far. */
+
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+static void init_pool (struct pool *, const char *name, void *base,
+                       size_t page_cnt, void *used_buf, void *order_buf,
+                       size_t first, size_t owned_cnt);
+static struct pool *page_to_pool (void *page);
+static bool in_home (const struct pool *, size_t page_idx, size_t page_cnt);
+static void move_pages (struct pool *from, struct pool *to,
+                        size_t page_idx, size_t page_cnt);
+static bool borrow_pages (struct pool *, size_t page_cnt);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void release_zeroed (struct pool *);
+static void print_pool_stats (struct pool *);
 
 /* Initializes the page allocator. */
 void
@@ -56,16 +169,41 @@ palloc_init (void)
   uint8_t *free_start = pg_round_up (&_end);
   uint8_t *free_end = ptov (ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
+  size_t bm_size = bitmap_buf_size (free_pages);
+  size_t meta_pages = DIV_ROUND_UP (3 * bm_size + 2 * free_pages, PGSIZE);
+  size_t page_cnt, user_pages;
+  uint8_t *meta = free_start;
+
+  /* Put the pools' bitmaps and order maps, and user_map, at the
+     start of free memory.  The pages that hold them are not
+     part of either pool. */
+  if (meta_pages >= free_pages)
+    PANIC ("Not enough memory for page allocator.");
+  page_cnt = free_pages - meta_pages;
+  user_map = bitmap_create_in_buf (page_cnt, meta, bm_size);
+  meta += bm_size;
+
+  /* Give half of memory to kernel, half to user. */
+  user_pages = page_cnt / 2;
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+  user_start = page_cnt - user_pages;
+  bitmap_set_multiple (user_map, user_start, user_pages, true);
+  init_pool (&kernel_pool, "kernel pool", free_start + meta_pages * PGSIZE,
+             page_cnt, meta, meta + bm_size, 0, page_cnt - user_pages);
+  meta += bm_size + page_cnt;
+  init_pool (&user_pool, "user pool", free_start + meta_pages * PGSIZE,
+             page_cnt, meta, meta + bm_size, page_cnt - user_pages,
+             user_pages);
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  kernel_pool.min_cnt = page_cnt / 4;
+  user_pool.min_cnt = page_cnt / 8;
+  if (user_pool.min_cnt > user_pages)
+    user_pool.min_cnt = user_pages;
+  user_pool.max_cnt = page_cnt - kernel_pool.min_cnt;
+  if (user_pool.max_cnt > user_page_limit)
+    user_pool.max_cnt = user_page_limit;
+  kernel_pool.max_cnt = page_cnt - user_pool.min_cnt;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -78,25 +216,53 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
+  enum intr_level old_level;
+  void *pages = NULL;
+  bool zeroed = false;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  if (!lock_acquire (&pool->lock))
-     return NULL;
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  old_level = intr_disable ();
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      if (!list_empty (&pool->zeroed))
+        {
+          pages = list_pop_front (&pool->zeroed);
+          pool->zeroed_cnt--;
+          pool->zero_hits++;
+          pool->alloc_cnt++;
+          zeroed = true;
+        }
+      else
+        pool->zero_misses++;
+    }
+  if (pages == NULL)
+    {
+      page_idx = alloc_pages (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0)
+        {
+          release_zeroed (pool);
+          page_idx = alloc_pages (pool, page_cnt);
+        }
+      if (page_idx == BITMAP_ERROR && borrow_pages (pool, page_cnt))
+        page_idx = alloc_pages (pool, page_cnt);
+      if (page_idx != BITMAP_ERROR)
+        {
+          pages = pool->base + PGSIZE * page_idx;
+          pool->alloc_cnt++;
+        }
+      else
+        pool->fail_cnt++;
+    }
+  intr_set_level (old_level);
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if (zeroed)
+        memset (pages, 0, sizeof (struct free_block));
+      else if (flags & PAL_ZERO)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -126,27 +292,38 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
-    NOT_REACHED ();
-
+  pool = page_to_pool (pages);
   page_idx = pg_no (pages) - pg_no (pool->base);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (!in_home (pool, page_idx, page_cnt)
+      && pool->free_cnt >= 2 * (pool->owned_cnt / LOW_WATER_DIV))
+    {
+      /* POOL borrowed these pages and has plenty free.  Return
+         them to the other pool, so that each pool's pages stay
+         together. */
+      struct pool *other = pool == &user_pool ? &kernel_pool : &user_pool;
+      move_pages (pool, other, page_idx, page_cnt);
+      pool->returned_cnt += page_cnt;
+    }
+  else
+    {
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+      free_pages (pool, page_idx, page_cnt);
+    }
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -156,35 +333,384 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+/* Initializes pool P, named NAME for debugging purposes, to
+   index the PAGE_CNT pages starting at BASE and to own the
+   OWNED_CNT of them starting at index FIRST.  Its used_map goes
+   in USED_BUF and its order_map in ORDER_BUF. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_pool (struct pool *p, const char *name, void *base, size_t page_cnt,
+           void *used_buf, void *order_buf, size_t first, size_t owned_cnt) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  int order;
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+  printf ("%zu pages available in %s.\n", owned_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->name = name;
+  p->used_map = bitmap_create_in_buf (page_cnt, used_buf,
+                                      bitmap_buf_size (page_cnt));
+  p->order_map = order_buf;
+  p->base = base;
+  p->page_cnt = page_cnt;
+  p->owned_cnt = owned_cnt;
+  p->min_cnt = 0;
+  p->max_cnt = page_cnt;
+  p->free_cnt = 0;
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free[order]);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  memset (p->order_map, NOT_FREE, page_cnt);
+
+  /* The pages the pool owns start out free.  The others belong
+     to the other pool. */
+  bitmap_set_all (p->used_map, true);
+  bitmap_set_multiple (p->used_map, first, owned_cnt, false);
+  free_pages (p, first, owned_cnt);
 }
 
-/* Returns true if PAGE was allocated from POOL,
-   false otherwise. */
-static bool
-page_from_pool (const struct pool *pool, void *page) 
+/* Returns the pool that owns PAGE. */
+static struct pool *
+page_to_pool (void *page) 
 {
   size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t start_page = pg_no (kernel_pool.base);
+
+  ASSERT (page_no >= start_page
+          && page_no < start_page + kernel_pool.page_cnt);
+  return (bitmap_test (user_map, page_no - start_page)
+          ? &user_pool : &kernel_pool);
+}
+
+/* Returns true if the PAGE_CNT pages at PAGE_IDX all lie among
+   the pages that POOL owned at boot. */
+static bool
+in_home (const struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  if (pool == &user_pool)
+    return page_idx >= user_start;
+  else
+    return page_idx + page_cnt <= user_start;
+}
+
+/* Returns the free block that begins at page PAGE_IDX in
+   POOL. */
+static struct free_block *
+block_at (const struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the page index of free block B in POOL. */
+static size_t
+block_idx (const struct pool *pool, struct free_block *b)
+{
+  return ((uint8_t *) b - pool->base) / PGSIZE;
+}
+
+/* Adds the free block of 2**ORDER pages at PAGE_IDX to POOL's
+   free list for ORDER. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order)
+{
+  pool->order_map[page_idx] = order;
+  list_push_front (&pool->free[order], &block_at (pool, page_idx)->elem);
+}
+
+/* Removes the free block at PAGE_IDX from its free list in
+   POOL. */
+static void
+remove_block (struct pool *pool, size_t page_idx)
+{
+  pool->order_map[page_idx] = NOT_FREE;
+  list_remove (&block_at (pool, page_idx)->elem);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no free block
+   large enough.  Interrupts must be off. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt)
+{
+  int want, order;
+  size_t page_idx;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Find the smallest order that holds PAGE_CNT pages, then the
+     smallest nonempty free list at least that large. */
+  for (want = 0; want < ORDER_CNT && ((size_t) 1 << want) < page_cnt; want++)
+    continue;
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free[order]))
+      break;
+  if (order >= ORDER_CNT)
+    return BITMAP_ERROR;
+
+  page_idx = block_idx (pool, list_entry (list_front (&pool->free[order]),
+                                          struct free_block, elem));
+  remove_block (pool, page_idx);
+
+  /* Split off the upper halves that we don't need. */
+  while (order > want)
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+      pool->split_cnt++;
+    }
+
+  /* Give back the pages beyond PAGE_CNT at the end of the
+     block. */
+  pool->free_cnt -= (size_t) 1 << want;
+  free_pages (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+
+  ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX in POOL to its
+   free lists, merging them with free buddies.  Interrupts must be
+   off, except during initialization. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t end = page_idx + page_cnt;
+
+  pool->free_cnt += page_cnt;
+  while (page_idx < end)
+    {
+      /* Free the largest aligned block that starts at PAGE_IDX
+         and fits before END. */
+      size_t idx = page_idx;
+      int order = 0;
+
+      while (order + 1 < ORDER_CNT
+             && (idx & (((size_t) 1 << (order + 1)) - 1)) == 0
+             && idx + ((size_t) 1 << (order + 1)) <= end)
+        order++;
+      page_idx += (size_t) 1 << order;
+
+      /* Merge with the block's buddy as long as the buddy is a
+         free block of the same order. */
+      while (order + 1 < ORDER_CNT)
+        {
+          size_t buddy = idx ^ ((size_t) 1 << order);
+          if (buddy >= pool->page_cnt || pool->order_map[buddy] != order)
+            break;
+          remove_block (pool, buddy);
+          pool->merge_cnt++;
+          if (buddy < idx)
+            idx = buddy;
+          order++;
+        }
+      push_block (pool, idx, order);
+    }
+}
+
+/* Gives the PAGE_CNT pages at PAGE_IDX, which are marked in use
+   in FROM, to TO as free pages.  The pages stay marked in use in
+   FROM's used_map.  Interrupts must be off. */
+static void
+move_pages (struct pool *from, struct pool *to, size_t page_idx,
+            size_t page_cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (bitmap_all (from->used_map, page_idx, page_cnt));
+  ASSERT (bitmap_all (to->used_map, page_idx, page_cnt));
+
+  bitmap_set_multiple (user_map, page_idx, page_cnt, to == &user_pool);
+  bitmap_set_multiple (to->used_map, page_idx, page_cnt, false);
+  free_pages (to, page_idx, page_cnt);
+  from->owned_cnt -= page_cnt;
+  to->owned_cnt += page_cnt;
+
+  balance[balance_cnt++ % BALANCE_CNT] = (struct balance) {
+    .ticks = timer_ticks (),
+    .user_cnt = user_pool.owned_cnt,
+  };
+}
+
+/* Tries to move PAGE_CNT free contiguous pages from the other
+   pool into POOL, rounded up to a power of two, or MIGRATE_CNT
+   pages if that is more.  Returns true if successful, false if
+   the other pool could not spare them.  Interrupts must be off. */
+static bool
+borrow_pages (struct pool *pool, size_t page_cnt)
+{
+  struct pool *other = pool == &user_pool ? &kernel_pool : &user_pool;
+  size_t block = 1;
+  size_t cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Move a whole buddy block, so that POOL can hand out PAGE_CNT
+     pages from it: fewer pages would be freed into POOL as
+     smaller blocks. */
+  while (block < page_cnt)
+    block <<= 1;
+  cnt = block > MIGRATE_CNT ? block : MIGRATE_CNT;
+
+  for (;;)
+    {
+      size_t page_idx = BITMAP_ERROR;
+
+      if (pool->owned_cnt + cnt <= pool->max_cnt
+          && other->owned_cnt >= other->min_cnt + cnt
+          && other->free_cnt >= cnt + other->owned_cnt / LOW_WATER_DIV)
+        page_idx = alloc_pages (other, cnt);
+
+      if (page_idx != BITMAP_ERROR)
+        {
+          move_pages (other, pool, page_idx, cnt);
+          other->lent_cnt += cnt;
+          pool->borrowed_cnt += cnt;
+          return true;
+        }
+      else if (cnt > block)
+        cnt = block;
+      else
+        return false;
+    }
+}
+
+/* Returns POOL's pre-zeroed pages to its free lists.
+   Interrupts must be off. */
+static void
+release_zeroed (struct pool *pool)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&pool->zeroed))
+    {
+      size_t page_idx = block_idx (pool, list_entry (list_pop_front
+                                                     (&pool->zeroed),
+                                                     struct free_block,
+                                                     elem));
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+  pool->zeroed_cnt = 0;
+}
+
+/* Zeroes one free page and adds it to the pre-zeroed pages of
+   the first pool that has fewer than ZEROED_MAX of them.
+   Returns true if it did, false if no pool needed one.  Called
+   by the idle thread with interrupts on. */
+bool
+palloc_prezero (void)
+{
+  struct pool *pools[] = {&kernel_pool, &user_pool};
+  enum intr_level old_level;
+  uint64_t start;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  for (i = 0; i < sizeof pools / sizeof *pools; i++)
+    {
+      struct pool *pool = pools[i];
+      size_t page_idx;
+      uint8_t *page;
+
+      /* Leave at least as many pages free as we pre-zero. */
+      old_level = intr_disable ();
+      if (pool->zeroed_cnt >= ZEROED_MAX || pool->free_cnt <= ZEROED_MAX)
+        page_idx = BITMAP_ERROR;
+      else
+        page_idx = alloc_pages (pool, 1);
+      intr_set_level (old_level);
+      if (page_idx == BITMAP_ERROR)
+        continue;
+
+      page = pool->base + PGSIZE * page_idx;
+      start = timer_cycles ();
+      memset (page, 0, PGSIZE);
+
+      old_level = intr_disable ();
+      list_push_back (&pool->zeroed, &((struct free_block *) page)->elem);
+      pool->zeroed_cnt++;
+      prezero_cnt++;
+      prezero_ns += timer_cycles_to_ns (timer_cycles () - start);
+      intr_set_level (old_level);
+      return true;
+    }
+  return false;
+}
+
+/* Returns the number of pages that the user pool can hand out
+   without borrowing from the kernel pool. */
+size_t
+palloc_user_free_cnt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t cnt = user_pool.free_cnt + user_pool.zeroed_cnt;
+  intr_set_level (old_level);
+  return cnt;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  enum intr_level old_level;
+  struct balance history[BALANCE_CNT];
+  unsigned cnt, i;
+
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+  printf ("Palloc: %lld pages zeroed when idle, in %"PRIu64" us\n",
+          prezero_cnt, prezero_ns / 1000);
+
+  old_level = intr_disable ();
+  cnt = balance_cnt;
+  memcpy (history, balance, sizeof history);
+  intr_set_level (old_level);
+
+  if (cnt > 0)
+    {
+      printf ("Palloc: %u moves between pools; user pool size after "
+              "the last %u:\n", cnt, cnt < BALANCE_CNT ? cnt : BALANCE_CNT);
+      for (i = cnt > BALANCE_CNT ? cnt - BALANCE_CNT : 0; i < cnt; i++)
+        printf ("Palloc:   tick %"PRId64": %zu pages\n",
+                history[i % BALANCE_CNT].ticks,
+                history[i % BALANCE_CNT].user_cnt);
+    }
+}
+
+/* Prints statistics for POOL: its use, and how fragmented its
+   free memory is, as the number of free blocks of each order up
+   to the largest that has any. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t blocks[ORDER_CNT];
+  int order, top = 0;
+
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      blocks[order] = list_size (&pool->free[order]);
+      if (blocks[order] > 0)
+        top = order;
+    }
+  intr_set_level (old_level);
 
-  return page_no >= start_page && page_no < end_page;
+  printf ("Palloc: %s: %zu of %zu pages free, largest free block "
+          "%zu pages\n", pool->name, pool->free_cnt, pool->owned_cnt,
+          blocks[top] > 0 ? (size_t) 1 << top : 0);
+  printf ("Palloc: %s: %zu to %zu pages allowed, %lld pages borrowed, "
+          "%lld returned, %lld lent\n", pool->name, pool->min_cnt,
+          pool->max_cnt, pool->borrowed_cnt, pool->returned_cnt,
+          pool->lent_cnt);
+  printf ("Palloc: %s: %lld allocations, %lld failed, %lld splits, "
+          "%lld merges\n", pool->name, pool->alloc_cnt, pool->fail_cnt,
+          pool->split_cnt, pool->merge_cnt);
+  printf ("Palloc: %s: %zu pages pre-zeroed, %lld zeroed requests hit, "
+          "%lld missed\n", pool->name, pool->zeroed_cnt, pool->zero_hits,
+          pool->zero_misses);
+  printf ("Palloc: %s: free blocks by order:", pool->name);
+  for (order = 0; order <= top; order++)
+    printf (" %zu", blocks[order]);
+  printf ("\n");
 }
@@ -0,0 +1,317 @@
+#include "threads/sched.h"
+#include <debug.h>
+#include <hash.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Fair scheduler.
+
+   Each thread accumulates "virtual runtime": the CPU time it
+   has used, scaled down by a weight derived from its nice
+   value.  The fair class always runs the ready thread with the
+   least virtual runtime, so over time each thread receives a
+   share of the CPU proportional to its weight, and a thread
+   that sleeps a lot, such as an interactive one, comes back
+   with less virtual runtime than threads that have been
+   computing and runs promptly.
+
+   Ready threads are kept in a treap ordered by virtual runtime,
+   so that adding and removing a thread and finding the one to
+   run next take O(log n) expected time.  The running thread is
+   not in the treap. */
+
+/* Nanoseconds per timer tick. */
+#define TICK_NS (1000000000 / TIMER_FREQ)
+
+/* A running thread is preempted once its virtual runtime
+   exceeds that of the leftmost ready thread by this much, and a
+   thread that wakes up preempts the running thread if it is
+   behind by this much. */
+#define FAIR_GRANULARITY TICK_NS
+
+/* A thread that wakes up after sleeping is placed at most this
+   far behind the least virtual runtime in the class, so that
+   sleeping does not build up an unbounded claim on the CPU. */
+#define FAIR_SLEEPER_CREDIT (2 * TICK_NS)
+
+/* Weight of a thread with nice value 0. */
+#define NICE_0_WEIGHT 1024
+
+/* Weights for nice values -20 through 20.  Each step changes a
+   thread's share by about 10% relative to a thread one step
+   away. */
+static const unsigned nice_weights[] =
+  {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */  9548,  7620,  6100,  4904,  3906,
+    /*  -5 */  3121,  2501,  1991,  1586,  1277,
+    /*   0 */  1024,   820,   655,   526,   423,
+    /*   5 */   335,   272,   215,   172,   137,
+    /*  10 */   110,    87,    70,    56,    45,
+    /*  15 */    36,    29,    23,    18,    15,
+    /*  20 */    12,
+  };
+
+static struct fair_node *root;  /* Treap of ready threads. */
+static uint64_t min_vruntime;   /* Never decreases. */
+
+static uint64_t fair_clock (void);
+static unsigned fair_weight (const struct thread *);
+static void update_curr (struct thread *);
+static void update_min_vruntime (struct thread *cur);
+static struct thread *leftmost (void);
+static bool node_less (const struct fair_node *, const struct fair_node *);
+static void treap_insert (struct fair_node **, struct fair_node *);
+static void treap_remove (struct fair_node **, struct fair_node *);
+
+/* Returns the thread that owns treap node N. */
+#define node_thread(N) \
+        ((struct thread *) ((uint8_t *) (N) \
+                            - offsetof (struct thread, fair_node)))
+
+static void
+fair_init (void)
+{
+  root = NULL;
+  min_vruntime = 0;
+}
+
+/* T starts out level with the threads already in the class. */
+static void
+fair_attach (struct thread *t)
+{
+  t->vruntime = min_vruntime;
+  t->exec_start = fair_clock ();
+  t->fair_node.heap_key = hash_int (t->tid);
+}
+
+static void
+fair_detach (struct thread *t UNUSED)
+{
+}
+
+static void
+fair_enqueue (struct thread *t)
+{
+  uint64_t floor = (min_vruntime > FAIR_SLEEPER_CREDIT
+                    ? min_vruntime - FAIR_SLEEPER_CREDIT : 0);
+
+  if (t->vruntime < floor)
+    t->vruntime = floor;
+  treap_insert (&root, &t->fair_node);
+}
+
+/* T is removed from the treap only to run, so its run starts
+   now. */
+static void
+fair_dequeue (struct thread *t)
+{
+  treap_remove (&root, &t->fair_node);
+  t->exec_start = fair_clock ();
+}
+
+static struct thread *
+fair_pick_next (void)
+{
+  return leftmost ();
+}
+
+static bool
+fair_preempt (struct thread *cur, struct thread *t)
+{
+  update_curr (cur);
+  return t->vruntime + FAIR_GRANULARITY < cur->vruntime;
+}
+
+static bool
+fair_tick (struct thread *cur, unsigned ran UNUSED)
+{
+  struct thread *next;
+
+  if (cur == NULL || cur->sched_class != &sched_fair)
+    return false;
+  update_curr (cur);
+  next = leftmost ();
+  return next != NULL && next->vruntime + FAIR_GRANULARITY < cur->vruntime;
+}
+
+/* Charges CUR for the time it ran. */
+static void
+fair_yield (struct thread *cur)
+{
+  update_curr (cur);
+}
+
+/* Charges T for the time it ran so far; later time is charged
+   at the new weight. */
+static void
+fair_reweight (struct thread *t)
+{
+  update_curr (t);
+}
+
+const struct sched_class sched_fair =
+  {
+    "fair", false,
+    fair_init, fair_attach, fair_detach, fair_enqueue, fair_dequeue,
+    fair_pick_next, fair_preempt, fair_tick, fair_yield, fair_reweight
+  };
+
+/* Returns the current time in nanoseconds, from the TSC if
+   there is one, otherwise from the timer tick. */
+static uint64_t
+fair_clock (void)
+{
+  uint64_t ns = timer_ns ();
+  return ns != 0 ? ns : (uint64_t) timer_ticks () * TICK_NS;
+}
+
+/* Returns T's weight for its nice value. */
+static unsigned
+fair_weight (const struct thread *t)
+{
+  int nice = t->nice;
+
+  if (nice < -20)
+    nice = -20;
+  else if (nice > 20)
+    nice = 20;
+  return nice_weights[nice + 20];
+}
+
+/* Adds the time that running thread CUR has run since it was
+   last charged to its virtual runtime.  CUR is charged at least
+   once a tick, so a much longer interval can only mean that the
+   clock source changed, when timer_calibrate() enables the TSC;
+   such an interval is cut down to one tick. */
+static void
+update_curr (struct thread *cur)
+{
+  uint64_t now = fair_clock ();
+  uint64_t delta = now > cur->exec_start ? now - cur->exec_start : 0;
+
+  if (delta > 2 * TICK_NS)
+    delta = TICK_NS;
+  cur->exec_start = now;
+  cur->vruntime += delta * NICE_0_WEIGHT / fair_weight (cur);
+  update_min_vruntime (cur);
+}
+
+/* Advances min_vruntime to the least virtual runtime among
+   running thread CUR and the ready threads. */
+static void
+update_min_vruntime (struct thread *cur)
+{
+  struct thread *next = leftmost ();
+  uint64_t vruntime = cur->vruntime;
+
+  if (next != NULL && next->vruntime < vruntime)
+    vruntime = next->vruntime;
+  if (vruntime > min_vruntime)
+    min_vruntime = vruntime;
+}
+
+/* Returns the ready thread with the least virtual runtime, or a
+   null pointer if there are no ready threads. */
+static struct thread *
+leftmost (void)
+{
+  struct fair_node *n = root;
+
+  if (n == NULL)
+    return NULL;
+  while (n->left != NULL)
+    n = n->left;
+  return node_thread (n);
+}
+
+/* Treap order: by virtual runtime, then by tid, which makes
+   every key distinct. */
+static bool
+node_less (const struct fair_node *a, const struct fair_node *b)
+{
+  const struct thread *ta = node_thread (a);
+  const struct thread *tb = node_thread (b);
+
+  if (ta->vruntime != tb->vruntime)
+    return ta->vruntime < tb->vruntime;
+  return ta->tid < tb->tid;
+}
+
+/* Rotates the subtree rooted at *P to the right, making its
+   left child the new root. */
+static void
+rotate_right (struct fair_node **p)
+{
+  struct fair_node *n = *p;
+  struct fair_node *l = n->left;
+
+  n->left = l->right;
+  l->right = n;
+  *p = l;
+}
+
+/* Rotates the subtree rooted at *P to the left, making its
+   right child the new root. */
+static void
+rotate_left (struct fair_node **p)
+{
+  struct fair_node *n = *p;
+  struct fair_node *r = n->right;
+
+  n->right = r->left;
+  r->left = n;
+  *p = r;
+}
+
+/* Inserts N into the treap rooted at *P. */
+static void
+treap_insert (struct fair_node **p, struct fair_node *n)
+{
+  if (*p == NULL)
+    {
+      n->left = n->right = NULL;
+      *p = n;
+    }
+  else if (node_less (n, *p))
+    {
+      treap_insert (&(*p)->left, n);
+      if ((*p)->left->heap_key > (*p)->heap_key)
+        rotate_right (p);
+    }
+  else
+    {
+      treap_insert (&(*p)->right, n);
+      if ((*p)->right->heap_key > (*p)->heap_key)
+        rotate_left (p);
+    }
+}
+
+/* Removes N from the treap rooted at *P, which must contain
+   it, by rotating it down until it has at most one child. */
+static void
+treap_remove (struct fair_node **p, struct fair_node *n)
+{
+  ASSERT (*p != NULL);
+
+  if (*p != n)
+    treap_remove (node_less (n, *p) ? &(*p)->left : &(*p)->right, n);
+  else if (n->left == NULL)
+    *p = n->right;
+  else if (n->right == NULL)
+    *p = n->left;
+  else if (n->left->heap_key > n->right->heap_key)
+    {
+      rotate_right (p);
+      treap_remove (&(*p)->right, n);
+    }
+  else
+    {
+      rotate_left (p);
+      treap_remove (&(*p)->left, n);
+    }
+}
@@ -0,0 +1,393 @@
+#include "threads/sched.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+/* The priority scheduler and the multi-level feedback queue
+   scheduler.
+
+   Both keep their ready threads in a priority_queue: one FIFO
+   list per priority level, plus a bitmap in which bit P is set
+   if and only if the list for priority P is nonempty, so the
+   highest-priority ready thread is found with a single bit scan.
+   Each class runs the highest-priority ready thread, round-robin
+   among threads of equal priority.  The two differ only in where
+   priorities come from: the priority scheduler uses the
+   priorities that threads set for themselves, with donation,
+   and the MLFQS computes them from recent_cpu and nice. */
+
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+
+/* A run queue ordered by priority. */
+struct priority_queue
+  {
+    struct list lists[PRI_CNT]; /* One FIFO list per priority. */
+    uint64_t bitmap;            /* Bit P set if lists[P] nonempty. */
+  };
+
+static inline int bit_scan_high (uint64_t);
+static void pq_init (struct priority_queue *);
+static void pq_push (struct priority_queue *, struct thread *);
+static void pq_remove (struct priority_queue *, struct thread *);
+static struct thread *pq_front (struct priority_queue *);
+static bool pq_tick (struct priority_queue *, struct thread *cur,
+                     unsigned ran);
+
+/* Returns the index of the most significant set bit in BITS,
+   which must be nonzero.  Uses the BSR instruction on each
+   32-bit half, since there is no 64-bit form on IA-32. */
+static inline int
+bit_scan_high (uint64_t bits)
+{
+  uint32_t hi = bits >> 32;
+  uint32_t lo = bits;
+  uint32_t idx;
+
+  ASSERT (bits != 0);
+  if (hi != 0)
+    {
+      asm ("bsrl %1, %0" : "=r" (idx) : "rm" (hi));
+      return idx + 32;
+    }
+  asm ("bsrl %1, %0" : "=r" (idx) : "rm" (lo));
+  return idx;
+}
+
+/* Initializes PQ as empty. */
+static void
+pq_init (struct priority_queue *pq)
+{
+  int i;
+
+  for (i = 0; i < PRI_CNT; i++)
+    list_init (&pq->lists[i]);
+  pq->bitmap = 0;
+}
+
+/* Appends T to the list in PQ for its priority. */
+static void
+pq_push (struct priority_queue *pq, struct thread *t)
+{
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&pq->lists[t->priority], &t->elem);
+  pq->bitmap |= (uint64_t) 1 << t->priority;
+}
+
+/* Removes T from PQ. */
+static void
+pq_remove (struct priority_queue *pq, struct thread *t)
+{
+  list_remove (&t->elem);
+  if (list_empty (&pq->lists[t->priority]))
+    pq->bitmap &= ~((uint64_t) 1 << t->priority);
+}
+
+/* Returns the highest-priority thread in PQ that has waited
+   longest, or a null pointer if PQ is empty. */
+static struct thread *
+pq_front (struct priority_queue *pq)
+{
+  if (pq->bitmap == 0)
+    return NULL;
+  return list_entry (list_front (&pq->lists[bit_scan_high (pq->bitmap)]),
+                     struct thread, elem);
+}
+
+/* Returns true if running thread CUR, whose ready threads are in
+   PQ, should yield: because a higher-priority thread is ready,
+   or because CUR has used up its time slice and a thread of the
+   same priority is ready. */
+static bool
+pq_tick (struct priority_queue *pq, struct thread *cur, unsigned ran)
+{
+  struct thread *next = pq_front (pq);
+
+  return (next != NULL
+          && (cur->priority < next->priority
+              || (cur->priority == next->priority && ran > TIME_SLICE)));
+}
+
+/* Returns true if T has a higher priority than CUR. */
+static bool
+higher_priority (struct thread *cur, struct thread *t)
+{
+  return t->priority > cur->priority;
+}
+
+/* Does nothing. */
+static void
+no_op (struct thread *t UNUSED)
+{
+}
+
+/* Priority scheduler. */
+
+static struct priority_queue prio_queue;
+
+static void
+prio_init (void)
+{
+  pq_init (&prio_queue);
+}
+
+static void
+prio_enqueue (struct thread *t)
+{
+  pq_push (&prio_queue, t);
+}
+
+static void
+prio_dequeue (struct thread *t)
+{
+  pq_remove (&prio_queue, t);
+}
+
+static struct thread *
+prio_pick_next (void)
+{
+  return pq_front (&prio_queue);
+}
+
+static bool
+prio_tick (struct thread *cur, unsigned ran)
+{
+  return (cur != NULL && cur->sched_class == &sched_prio
+          && pq_tick (&prio_queue, cur, ran));
+}
+
+const struct sched_class sched_prio =
+  {
+    "prio", true,
+    prio_init, no_op, no_op, prio_enqueue, prio_dequeue, prio_pick_next,
+    higher_priority, prio_tick, no_op, no_op
+  };
+
+/* Multi-level feedback queue scheduler.
+
+   recent_cpu and load_avg are 17.14 fixed-point numbers.  Every
+   thread's recent_cpu decays once a second.  Instead of decaying
+   every thread in the timer interrupt, the interrupt only counts
+   the ready threads and hands the rest to the high-priority
+   worker, which updates load_avg, starts a new decay epoch, and
+   sweeps the class's threads with interrupts off for one thread
+   at a time.  The cost of a timer interrupt thus does not depend
+   on the number of threads.  A thread the sweep has not reached
+   yet is brought up to date by mlfqs_decay() whenever its
+   recent_cpu is needed. */
+
+/* 17.14 Fixed Point Arithmetic factor. */
+#define F (1 << 14)
+
+/* See thread.h. */
+int64_t load_average;
+
+static struct priority_queue mlfqs_queue;
+static struct list mlfqs_threads;       /* All threads in the class. */
+static unsigned decay_epoch;    /* # of decays so far. */
+static int64_t decay_quotient;  /* Coefficient of the last decay. */
+static struct list_elem *decay_cursor;  /* Next thread to sweep. */
+static int decay_ready;         /* Ready threads at the last second. */
+static struct work decay_work;  /* Runs mlfqs_recompute(). */
+
+static void mlfqs_decay (struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update (struct thread *);
+static work_func mlfqs_recompute;
+
+static void
+mlfqs_init (void)
+{
+  pq_init (&mlfqs_queue);
+  list_init (&mlfqs_threads);
+  work_init (&decay_work, mlfqs_recompute, NULL);
+}
+
+/* A new thread starts with its creator's recent_cpu, which may
+   be missing a decay or two.  A running thread switching in from
+   another class starts afresh, since no other class keeps its
+   recent_cpu up to date. */
+static void
+mlfqs_attach (struct thread *t)
+{
+  if (t->status == THREAD_RUNNING)
+    {
+      t->recent_cpu = 0;
+      t->decay_epoch = decay_epoch;
+    }
+  mlfqs_decay (t);
+  t->priority = t->old_priority = mlfqs_priority (t);
+  list_push_back (&mlfqs_threads, &t->class_elem);
+}
+
+static void
+mlfqs_detach (struct thread *t)
+{
+  if (decay_cursor == &t->class_elem)
+    decay_cursor = list_next (decay_cursor);
+  list_remove (&t->class_elem);
+}
+
+/* The sweep may not have reached T since the last decay, so
+   bring it up to date before queuing it. */
+static void
+mlfqs_enqueue (struct thread *t)
+{
+  if (t->decay_epoch != decay_epoch)
+    {
+      mlfqs_decay (t);
+      t->priority = t->old_priority = mlfqs_priority (t);
+    }
+  pq_push (&mlfqs_queue, t);
+}
+
+static void
+mlfqs_dequeue (struct thread *t)
+{
+  pq_remove (&mlfqs_queue, t);
+}
+
+static struct thread *
+mlfqs_pick_next (void)
+{
+  return pq_front (&mlfqs_queue);
+}
+
+/* Has load_avg updated and a new decay started once a second,
+   and recomputes CUR's priority every fourth tick.  Only the
+   running thread's recent_cpu changes between decays, so it is
+   the only priority that can. */
+static bool
+mlfqs_tick (struct thread *cur, unsigned ran)
+{
+  int64_t ticks = timer_ticks ();
+  bool mine = cur != NULL && cur->sched_class == &sched_mlfqs;
+
+  if (mine)
+    cur->recent_cpu += F;
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      decay_ready = thread_ready_cnt () + (cur != NULL);
+      workqueue_push (WQ_HIGH, &decay_work);
+    }
+
+  if (!mine)
+    return false;
+  if (ticks % 4 == 0)
+    mlfqs_update (cur);
+  return pq_tick (&mlfqs_queue, cur, ran);
+}
+
+static void
+mlfqs_reweight (struct thread *t)
+{
+  mlfqs_update (t);
+}
+
+const struct sched_class sched_mlfqs =
+  {
+    "mlfqs", false,
+    mlfqs_init, mlfqs_attach, mlfqs_detach, mlfqs_enqueue, mlfqs_dequeue,
+    mlfqs_pick_next, higher_priority, mlfqs_tick, no_op, mlfqs_reweight
+  };
+
+/* Applies to T any recent_cpu decays it has missed.  Decays
+   missed by more than one epoch, which happens only if a sweep
+   could not finish within a second, all use the latest
+   coefficient.  Interrupts must be off. */
+static void
+mlfqs_decay (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (; t->decay_epoch != decay_epoch; t->decay_epoch++)
+    t->recent_cpu = (decay_quotient * t->recent_cpu)/F + (t->nice * F);
+}
+
+/* Returns the MLFQS priority for T's recent_cpu and nice
+   values. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - (t->recent_cpu / (4*F)) - (t->nice * 2);
+  if (priority < PRI_MIN) priority = PRI_MIN;
+  if (priority > PRI_MAX) priority = PRI_MAX;
+  return priority;
+}
+
+/* Brings T's recent_cpu up to date and recomputes its
+   priority, moving it to a different run queue if needed. */
+static void
+mlfqs_update (struct thread *t)
+{
+  int new_priority;
+
+  mlfqs_decay (t);
+  new_priority = mlfqs_priority (t);
+  if (t->priority == new_priority)
+    return;
+
+  TRACE (TRACE_MLFQS, t, NULL, new_priority);
+  if (t->status == THREAD_READY)
+    pq_remove (&mlfqs_queue, t);
+  t->priority = t->old_priority = new_priority;
+  if (t->status == THREAD_READY)
+    pq_push (&mlfqs_queue, t);
+  else if (t->status == THREAD_BLOCKED)
+    sema_priority_changed (t);
+}
+
+/* Updates load_avg from the ready threads counted by the last
+   timer tick of a second, starts a new decay, and sweeps every
+   thread in the class.  Runs in the high-priority worker.
+   Interrupts are off only while a single thread is updated;
+   mlfqs_detach() keeps the cursor valid in between. */
+static void
+mlfqs_recompute (void *aux UNUSED)
+{
+  enum intr_level old_level = intr_disable ();
+
+  load_average = (((59*F/60) * load_average)
+                  + (( 1*F/60) * decay_ready * F))/F;
+  decay_quotient = (2*load_average*F) / (2*load_average + 1*F);
+  decay_epoch++;
+  for (decay_cursor = list_begin (&mlfqs_threads);
+       decay_cursor != list_end (&mlfqs_threads); )
+    {
+      struct thread *t = list_entry (decay_cursor, struct thread,
+                                     class_elem);
+
+      decay_cursor = list_next (decay_cursor);
+      mlfqs_update (t);
+      intr_set_level (old_level);
+      intr_disable ();
+    }
+  decay_cursor = NULL;
+  intr_set_level (old_level);
+}
+
+/* Returns 100 times the system load average. */
+int
+thread_get_load_avg (void)
+{
+  return (100 * load_average/F);
+}
+
+/* Returns 100 times the current thread's recent_cpu value. */
+int
+thread_get_recent_cpu (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  if (cur->sched_class == &sched_mlfqs)
+    mlfqs_decay (cur);
+  intr_set_level (old_level);
+  return (100 * cur->recent_cpu / F);
+}
@@ -0,0 +1,82 @@
+#ifndef THREADS_SCHED_H
+#define THREADS_SCHED_H
+
+#include <stdbool.h>
+
+struct thread;
+
+/* Node in the fair class's run queue, a treap of threads
+   ordered by virtual runtime. */
+struct fair_node
+  {
+    struct fair_node *left;             /* Lesser virtual runtimes. */
+    struct fair_node *right;            /* Greater virtual runtimes. */
+    unsigned heap_key;                  /* Treap heap order. */
+  };
+
+/* A scheduling class: one scheduling policy with its own run
+   queue.  Every thread belongs to exactly one class.  The
+   classes are ranked: a ready thread of a higher-ranked class
+   always runs before any thread of a lower-ranked class, and
+   each class decides among its own threads.
+
+   thread.c calls these functions with interrupts off.  A
+   thread's status is THREAD_READY for exactly as long as it is
+   in its class's run queue, except for the running thread,
+   which is never in a run queue. */
+struct sched_class
+  {
+    const char *name;           /* Name for "-sched=" and "sched". */
+    bool priority;              /* Honors thread_set_priority() and
+                                   priority donation? */
+
+    /* Initializes the class.  Called once by thread_init(). */
+    void (*init) (void);
+
+    /* T, which is not ready, has just joined the class, either
+       because it was created or because it switched classes. */
+    void (*attach) (struct thread *t);
+
+    /* T, which is not ready, is leaving the class, either
+       because it is exiting or because it is switching classes. */
+    void (*detach) (struct thread *t);
+
+    /* Adds ready thread T to the run queue. */
+    void (*enqueue) (struct thread *t);
+
+    /* Removes T from the run queue. */
+    void (*dequeue) (struct thread *t);
+
+    /* Returns the thread in the run queue that should run next,
+       without removing it, or a null pointer if the run queue is
+       empty. */
+    struct thread *(*pick_next) (void);
+
+    /* Returns true if T, which has just become ready, should
+       preempt CUR, which is running.  Both are in this class. */
+    bool (*preempt) (struct thread *cur, struct thread *t);
+
+    /* Called by every class at each timer tick, in an external
+       interrupt context, with the running thread CUR, or a null
+       pointer if the CPU is idle.  RAN is the number of ticks CUR
+       has run since it was last scheduled.  Returns true if CUR
+       is in this class and should give up the CPU to another
+       thread of the class. */
+    bool (*tick) (struct thread *cur, unsigned ran);
+
+    /* CUR, which is running, is about to give up the CPU, by
+       yielding, blocking, or exiting. */
+    void (*yield) (struct thread *cur);
+
+    /* The nice value of T, which is running, has changed. */
+    void (*reweight) (struct thread *t);
+  };
+
+/* Scheduling classes, from highest rank to lowest. */
+extern const struct sched_class sched_prio;
+extern const struct sched_class sched_mlfqs;
+extern const struct sched_class sched_fair;
+
+const struct sched_class *sched_find (const char *name);
+
+#endif /* threads/sched.h */
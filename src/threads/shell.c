@@ -7,14 +7,18 @@
 #endif
 #include "tests/threads/tests.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "filesys/filesys.h"
 
 static void read_line (char line[], size_t);
 static bool backspace (char **pos, char line[]);
 
 extern int userprog;
-extern bool thread_mlfqs;
 
 int
 shell_main (void)
@@ -34,13 +38,42 @@ shell_main (void)
       else if (!memcmp (command, "run ", 4))
        {
 	 userprog = 0;
-         if (!memcmp (command + 4, "mlfqs", 4))
-            thread_mlfqs = true;
          run_test (command + 4);
-         thread_mlfqs = false;
 	 userprog = 1;
          thread_set_priority (PRI_DEFAULT);
        }
+      else if (!strcmp (command, "sched"))
+        printf ("%s\n", thread_current ()->sched_class->name);
+      else if (!memcmp (command, "sched ", 6))
+        {
+          const struct sched_class *class = sched_find (command + 6);
+          if (class != NULL)
+            thread_set_sched_class (class);
+          else
+            printf ("unknown scheduling class\n");
+        }
+      else if (!strcmp (command, "trace start"))
+        trace_start ();
+      else if (!strcmp (command, "trace stop"))
+        trace_stop ();
+      else if (!strcmp (command, "trace dump"))
+        trace_dump ();
+      else if (!strcmp (command, "irqsoff"))
+        irqsoff_print_stats ();
+      else if (!strcmp (command, "irqsoff start"))
+        irqsoff_start_tracing ();
+      else if (!strcmp (command, "irqsoff stop"))
+        irqsoff_stop_tracing ();
+      else if (!strcmp (command, "lockstat"))
+        lockstat_print ();
+      else if (!strcmp (command, "lockstat reset"))
+        lockstat_reset ();
+      else if (!strcmp (command, "palloc"))
+        palloc_print_stats ();
+      else if (!strcmp (command, "malloc"))
+        malloc_stats ();
+      else if (!strcmp (command, "slab"))
+        slab_print_stats ();
       else if (!memcmp (command, "cd ", 3)) 
         chdir (command + 3);
       else if (command[0] == '\0') 
@@ -0,0 +1,270 @@
+#include "threads/slab.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches for fixed-size kernel objects.
+
+   Each cache hands out objects of exactly one size, carved out
+   of one-page "slabs".  A slab begins with a header and a bitmap
+   of its objects in use, followed by the objects themselves, so
+   the only space lost is the header and whatever is left over at
+   the end of the page, instead of the up to half of every block
+   that malloc()'s power-of-2 rounding wastes.
+
+   A cache keeps the slabs that have a free object on a list.
+   Full slabs are on no list; freeing an object in one puts it
+   back.  A cache keeps one slab that has no object in use, so
+   that alternately allocating and freeing one object does not
+   call the page allocator each time, and gives any other empty
+   slab back to the page allocator.
+
+   If a cache has a constructor, it is called on every object of
+   a slab when the slab is created, and objects must be in their
+   constructed state when they are freed, so that slab_alloc()
+   can return them without calling it again.
+
+   Caches are protected by disabling interrupts, like the page
+   allocator, because each operation is short. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab0b1e
+
+/* Slab header, at the start of each slab's page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's `slabs' list. */
+    size_t free_cnt;            /* Number of free objects. */
+    size_t hint;                /* No free object below this index. */
+    struct bitmap *used_map;    /* Objects in use. */
+  };
+
+/* All caches. */
+static struct list caches;
+
+static struct slab *obj_to_slab (struct slab_cache *, void *);
+static void *slab_to_obj (struct slab *, size_t idx);
+
+/* Initializes the slab allocator. */
+void
+slab_init (void) 
+{
+  list_init (&caches);
+}
+
+/* Initializes CACHE for objects of SIZE bytes, which must be at
+   most a quarter of a page, so that a slab holds at least three
+   of them.  If CTOR is nonnull, it
+   is called on each object when its slab is created.  NAME is
+   used only for statistics. */
+void
+slab_cache_init (struct slab_cache *cache, const char *name, size_t size,
+                 slab_ctor *ctor) 
+{
+  size_t obj_cnt;
+
+  ASSERT (cache != NULL);
+  ASSERT (name != NULL);
+  ASSERT (size > 0 && size <= PGSIZE / 4);
+
+  /* Keep objects aligned to a word. */
+  size = ROUND_UP (size, sizeof (void *));
+
+  /* Fit as many objects as possible after the header and the
+     bitmap. */
+  for (obj_cnt = (PGSIZE - sizeof (struct slab)) / size; ; obj_cnt--)
+    {
+      size_t ofs = ROUND_UP (sizeof (struct slab) + bitmap_buf_size (obj_cnt),
+                             sizeof (void *));
+      if (ofs + obj_cnt * size <= PGSIZE)
+        {
+          cache->obj_ofs = ofs;
+          break;
+        }
+    }
+
+  ASSERT (obj_cnt >= 3);
+
+  cache->name = name;
+  cache->obj_size = size;
+  cache->obj_cnt = obj_cnt;
+  cache->ctor = ctor;
+  list_init (&cache->slabs);
+  cache->empty_cnt = 0;
+  cache->slab_cnt = cache->in_use = 0;
+  cache->alloc_cnt = cache->fail_cnt = 0;
+  cache->grow_cnt = cache->shrink_cnt = 0;
+  list_push_back (&caches, &cache->elem);
+}
+
+/* Obtains a new slab for CACHE from the page allocator and adds
+   it to CACHE's list of slabs.  Returns the new slab, or a null
+   pointer if no page is available. */
+static struct slab *
+grow (struct slab_cache *cache) 
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->free_cnt = cache->obj_cnt;
+  s->hint = 0;
+  s->used_map = bitmap_create_in_buf (cache->obj_cnt, s + 1,
+                                      cache->obj_ofs - sizeof *s);
+  if (cache->ctor != NULL)
+    for (i = 0; i < cache->obj_cnt; i++)
+      cache->ctor (slab_to_obj (s, i));
+
+  list_push_front (&cache->slabs, &s->elem);
+  cache->empty_cnt++;
+  cache->slab_cnt++;
+  cache->grow_cnt++;
+  return s;
+}
+
+/* Obtains and returns an object from CACHE.  Returns a null
+   pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *cache) 
+{
+  enum intr_level old_level;
+  struct slab *s;
+  size_t idx;
+
+  ASSERT (cache != NULL);
+
+  old_level = intr_disable ();
+  if (!list_empty (&cache->slabs))
+    s = list_entry (list_front (&cache->slabs), struct slab, elem);
+  else
+    {
+      s = grow (cache);
+      if (s == NULL) 
+        {
+          cache->fail_cnt++;
+          intr_set_level (old_level);
+          return NULL;
+        }
+    }
+
+  idx = bitmap_scan_and_flip (s->used_map, s->hint, 1, false);
+  ASSERT (idx != BITMAP_ERROR);
+  s->hint = idx + 1;
+  if (s->free_cnt-- == cache->obj_cnt)
+    cache->empty_cnt--;
+  if (s->free_cnt == 0)
+    list_remove (&s->elem);
+  cache->in_use++;
+  cache->alloc_cnt++;
+  intr_set_level (old_level);
+
+  return slab_to_obj (s, idx);
+}
+
+/* Frees OBJ, which must have been allocated from CACHE. */
+void
+slab_free (struct slab_cache *cache, void *obj) 
+{
+  enum intr_level old_level;
+  struct slab *s;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (cache, obj);
+  idx = ((uint8_t *) obj - (uint8_t *) s - cache->obj_ofs) / cache->obj_size;
+  ASSERT (bitmap_test (s->used_map, idx));
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it must keep its constructed state. */
+  if (cache->ctor == NULL)
+    memset (obj, 0xcc, cache->obj_size);
+#endif
+
+  old_level = intr_disable ();
+  bitmap_reset (s->used_map, idx);
+  if (idx < s->hint)
+    s->hint = idx;
+  if (s->free_cnt++ == 0)
+    list_push_front (&cache->slabs, &s->elem);
+  cache->in_use--;
+
+  if (s->free_cnt == cache->obj_cnt) 
+    {
+      /* The slab is empty.  Keep it if it is the only one. */
+      if (cache->empty_cnt > 0) 
+        {
+          list_remove (&s->elem);
+          s->magic = 0;
+          palloc_free_page (s);
+          cache->slab_cnt--;
+          cache->shrink_cnt++;
+        }
+      else
+        cache->empty_cnt++;
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints statistics for each cache. */
+void
+slab_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+    {
+      struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+
+      printf ("Slab: %s: %zu-byte objects, %zu per slab, "
+              "%zu of %zu in use in %zu slabs\n",
+              c->name, c->obj_size, c->obj_cnt,
+              c->in_use, c->slab_cnt * c->obj_cnt, c->slab_cnt);
+      printf ("Slab: %s: %lld allocations, %lld failed, "
+              "%lld slabs created, %lld freed\n",
+              c->name, c->alloc_cnt, c->fail_cnt,
+              c->grow_cnt, c->shrink_cnt);
+    }
+}
+
+/* Returns the slab of CACHE that OBJ is inside. */
+static struct slab *
+obj_to_slab (struct slab_cache *cache, void *obj) 
+{
+  struct slab *s = pg_round_down (obj);
+
+  /* Check that the slab is valid. */
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+
+  /* Check that the object is properly aligned for the slab. */
+  ASSERT (pg_ofs (obj) >= cache->obj_ofs);
+  ASSERT ((pg_ofs (obj) - cache->obj_ofs) % cache->obj_size == 0);
+
+  return s;
+}
+
+/* Returns the IDX'th object within slab S. */
+static void *
+slab_to_obj (struct slab *s, size_t idx) 
+{
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (idx < s->cache->obj_cnt);
+  return (uint8_t *) s + s->cache->obj_ofs + idx * s->cache->obj_size;
+}
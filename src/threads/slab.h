@@ -0,0 +1,38 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+
+/* Called on each object of a slab when the slab is created. */
+typedef void slab_ctor (void *obj);
+
+/* A cache of objects of a single size. */
+struct slab_cache
+  {
+    const char *name;           /* Name for statistics. */
+    size_t obj_size;            /* Size of each object in bytes. */
+    size_t obj_cnt;             /* Number of objects in a slab. */
+    size_t obj_ofs;             /* Offset of the first object in a slab. */
+    slab_ctor *ctor;            /* Constructor, or a null pointer. */
+    struct list slabs;          /* Slabs with at least one free object. */
+    size_t empty_cnt;           /* Slabs with no object in use. */
+    struct list_elem elem;      /* Element in list of all caches. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs in the cache. */
+    size_t in_use;              /* Objects in use. */
+    long long alloc_cnt;        /* # of objects allocated. */
+    long long fail_cnt;         /* # of failed allocations. */
+    long long grow_cnt;         /* # of slabs created. */
+    long long shrink_cnt;       /* # of slabs freed. */
+  };
+
+void slab_init (void);
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+                      slab_ctor *);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -33,6 +33,192 @@
 #include "threads/thread.h"
 #include "threads/malloc.h"
 #include "threads/deadlock.h"
+#include "devices/timer.h"
+
+/* This file defines lock_init() itself. */
+#undef lock_init
+
+#ifdef LOCKSTAT
+static void lockstat_acquired (struct lock *, uint64_t wait_start);
+static void lockstat_released (struct lock *);
+#endif
+
+/* Wait queues.
+
+   A wait queue is a pairing heap (Fredman, Sedgewick, Sleator
+   and Tarjan, "The pairing heap: a new form of self-adjusting
+   heap", Algorithmica 1, 1986).  Each element
+   points to its first child and to its next sibling.  Its
+   `prev' member points to its previous sibling or, if it is the
+   first child, to its parent, so that any element can be cut
+   out of the heap in constant time. */
+
+/* Returns true if A should leave its wait queue before B. */
+static bool
+wait_before (const struct wait_elem *a, const struct wait_elem *b)
+{
+  return a->key > b->key
+         || (a->key == b->key && (int) (a->seq - b->seq) < 0);
+}
+
+/* Merges the heaps rooted at A and B, either of which may be
+   null, and returns the root of the result. */
+static struct wait_elem *
+wait_merge (struct wait_elem *a, struct wait_elem *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (wait_before (b, a))
+    {
+      struct wait_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  return a;
+}
+
+/* Merges the list of sibling heaps starting at FIRST into a
+   single heap, in the usual two passes: pairs from left to
+   right, then the pairs from right to left.  Returns the root of
+   the result. */
+static struct wait_elem *
+wait_merge_pairs (struct wait_elem *first)
+{
+  struct wait_elem *pairs = NULL;
+  struct wait_elem *root = NULL;
+
+  while (first != NULL)
+    {
+      struct wait_elem *a = first;
+      struct wait_elem *b = a->next;
+
+      first = b != NULL ? b->next : NULL;
+      a->prev = a->next = NULL;
+      if (b != NULL)
+        b->prev = b->next = NULL;
+      a = wait_merge (a, b);
+      a->next = pairs;
+      pairs = a;
+    }
+  while (pairs != NULL)
+    {
+      struct wait_elem *next = pairs->next;
+      pairs->next = NULL;
+      root = wait_merge (pairs, root);
+      pairs = next;
+    }
+  return root;
+}
+
+/* Adds E, whose key and sequence number are set, to Q. */
+static void
+wait_insert (struct wait_queue *q, struct wait_elem *e)
+{
+  e->queue = q;
+  e->child = e->next = e->prev = NULL;
+  q->root = wait_merge (q->root, e);
+}
+
+/* Initializes Q as an empty wait queue. */
+void
+wait_queue_init (struct wait_queue *q)
+{
+  ASSERT (q != NULL);
+
+  q->root = NULL;
+  q->seq = 0;
+}
+
+/* Returns true if Q is empty. */
+bool
+wait_queue_empty (const struct wait_queue *q)
+{
+  return q->root == NULL;
+}
+
+/* Inserts E into Q with the given KEY.  E leaves Q after every
+   element with a greater key and every element with the same key
+   inserted before it. */
+void
+wait_queue_push (struct wait_queue *q, struct wait_elem *e, int key)
+{
+  ASSERT (e->queue == NULL);
+
+  e->key = key;
+  e->seq = q->seq++;
+  wait_insert (q, e);
+}
+
+/* Returns the element that leaves Q next, without removing it.
+   Q must not be empty. */
+struct wait_elem *
+wait_queue_max (const struct wait_queue *q)
+{
+  ASSERT (!wait_queue_empty (q));
+
+  return q->root;
+}
+
+/* Removes and returns the element that leaves Q next.  Q must
+   not be empty. */
+struct wait_elem *
+wait_queue_pop (struct wait_queue *q)
+{
+  struct wait_elem *e = wait_queue_max (q);
+
+  wait_queue_remove (e);
+  return e;
+}
+
+/* Removes E from the wait queue that contains it. */
+void
+wait_queue_remove (struct wait_elem *e)
+{
+  struct wait_queue *q = e->queue;
+  struct wait_elem *children;
+
+  ASSERT (q != NULL);
+
+  if (e != q->root)
+    {
+      if (e->prev->child == e)
+        e->prev->child = e->next;
+      else
+        e->prev->next = e->next;
+      if (e->next != NULL)
+        e->next->prev = e->prev;
+    }
+  else
+    q->root = NULL;
+
+  children = wait_merge_pairs (e->child);
+  q->root = wait_merge (q->root, children);
+  e->queue = NULL;
+}
+
+/* Changes the key of E, which must be in a wait queue, to KEY.
+   E keeps its place among elements with the same key. */
+void
+wait_queue_rekey (struct wait_elem *e, int key)
+{
+  struct wait_queue *q = e->queue;
+
+  ASSERT (q != NULL);
+
+  if (e->key == key)
+    return;
+  wait_queue_remove (e);
+  e->key = key;
+  wait_insert (q, e);
+}
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -50,7 +236,7 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  wait_queue_init (&sema->waiters);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -72,8 +258,8 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0)
     {
-      list_insert_ordered (&sema->waiters, &thread_current ()->elem, 
-                           priority_less, NULL);
+      struct thread *cur = thread_current ();
+      wait_queue_push (&sema->waiters, &cur->wait_elem, cur->priority);
       thread_block ();
     }
   sema->value--;
@@ -117,12 +303,9 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
   old_level = intr_disable ();
   sema->value++;
-  if (!list_empty (&sema->waiters))
-   {
-     struct list_elem *e = list_max (&sema->waiters, priority_less, NULL);
-     list_remove (e);
-     thread_unblock(list_entry (e, struct thread, elem));
-   }
+  if (!wait_queue_empty (&sema->waiters))
+    thread_unblock (wait_queue_entry (wait_queue_pop (&sema->waiters),
+                                      struct thread, wait_elem));
   intr_set_level (old_level);
 }
 
@@ -139,12 +322,25 @@ sema_broadcast (struct semaphore *sema)
 
   old_level = intr_disable ();
   
-  while (!list_empty (&sema->waiters))
+  while (!wait_queue_empty (&sema->waiters))
         sema_up (sema); 
 
   intr_set_level (old_level);
 }
 
+/* Moves T within the wait queues it is on, after a change in
+   T's priority.  Interrupts must be off. */
+void
+sema_priority_changed (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->wait_elem.queue != NULL)
+    wait_queue_rekey (&t->wait_elem, t->priority);
+  if (t->cond_elem != NULL && t->cond_elem->queue != NULL)
+    wait_queue_rekey (t->cond_elem, t->priority);
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -205,17 +401,14 @@ lock_init (struct lock *lock)
   lock->holder = NULL;
   lock->id = -1;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCKSTAT
+  lock->stat = NULL;
+#endif
 
   if (mem_initialized)
   {
      static int id = 0;
-     struct lock_elem *this = (struct lock_elem*)
-                               malloc (sizeof (struct lock_elem));
-     
-     this->lock = lock;
      lock->id = id++;
-     this->id = lock->id;
-     list_push_back (&lock_list, &this->elem);
   }
 }
 
@@ -238,38 +431,35 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  struct list_elem *e;
-  struct lock_elem *l;
   struct thread *cur = thread_current ();
 
+  if ((lock->semaphore.value == 0) && detect_deadlocks (lock->holder, cur))
+     return false;
+
   enum intr_level old_level = intr_disable ();
+#ifdef LOCKSTAT
+  uint64_t wait_start = lock->holder != NULL ? timer_ns () : 0;
+#endif
 
-  for (e = list_begin (&lock_list); e != list_end (&lock_list);
-       e = list_next (e))
+  /* Donate our priority down the chain of holders we would be
+     waiting behind. */
+  if (lock->holder != NULL)
    {
-     l = list_entry (e, struct lock_elem, elem);
-     if (lock->id == l->id)
-        break;
+     cur->waiting_lock = lock;
+     if (cur->sched_class->priority)
+        thread_donate_priority (cur);
    }
 
-  if (e == list_end (&lock_list) && lock->id >= 0 )
-   { 
-     struct lock_elem *this = (struct lock_elem *)
-                               malloc (sizeof (struct lock_elem));
-     this->lock = lock;
-     this->id = lock->id;
-     list_push_back (&lock_list, &this->elem);
-   }
-
-  intr_set_level (old_level);
-
-  if ((lock->semaphore.value == 0) && detect_deadlocks (lock->holder, cur))
-     return false;
-
   sema_down (&lock->semaphore);
+  cur->waiting_lock = NULL;
   lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+#ifdef LOCKSTAT
+  lockstat_acquired (lock, wait_start);
+#endif
+
+  intr_set_level (old_level);
   return true;
-  
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -288,7 +478,15 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+   {
+     enum intr_level old_level = intr_disable ();
+     lock->holder = thread_current ();
+     list_push_back (&lock->holder->held_locks, &lock->elem);
+#ifdef LOCKSTAT
+     lockstat_acquired (lock, 0);
+#endif
+     intr_set_level (old_level);
+   }
   return success;
 }
 
@@ -305,37 +503,23 @@ lock_release (struct lock *lock)
 
   enum intr_level old_level = intr_disable ();
 
-  bool yield = false;
+  struct thread *cur = thread_current ();
+  int old_priority = cur->priority;
 
+#ifdef LOCKSTAT
+  lockstat_released (lock);
+#endif
   lock->holder = NULL;
+  list_remove (&lock->elem);
 
-  struct thread *cur = thread_current ();
-  if (cur->priority > cur->old_priority)
-   {
-     yield = true;
-     cur->priority = cur->old_priority;
-   }
-
-  if (list_size (&lock->semaphore.waiters) <=1) 
-   { 
-     struct list_elem *e;
-     struct lock_elem *l;
-     for (e = list_begin (&lock_list); e != list_end (&lock_list);
-          e = list_next (e))
-      {
-        l = list_entry (e, struct lock_elem, elem);
-        if (lock->id == l->id)
-         {
-           list_remove (e);
-           free (l);
-           break;
-         }
-      }
-   }  
+  /* Give back whatever was donated through this lock. */
+  if (cur->sched_class->priority)
+     thread_update_priority (cur);
 
   sema_up (&lock->semaphore);
 
-  if (yield) thread_yield ();
+  if (cur->priority < old_priority)
+     thread_yield ();
   
   intr_set_level (old_level);
 
@@ -353,6 +537,156 @@ lock_held_by_current_thread (const struct lock *lock)
 }
 
 
+#ifdef LOCKSTAT
+/* Lock initialization sites seen so far. */
+static struct lockstat *lockstat_sites;
+
+/* Number of sites lockstat_print() shows. */
+#define LOCKSTAT_TOP 10
+
+/* Charges LOCK, just initialized, to initialization site SITE. */
+void
+lockstat_register (struct lock *lock, struct lockstat *site)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (!site->registered)
+    {
+      site->next = lockstat_sites;
+      lockstat_sites = site;
+      site->registered = true;
+    }
+  lock->stat = site;
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread acquired LOCK, having started
+   to wait for it at WAIT_START, or without waiting if WAIT_START
+   is 0. */
+static void
+lockstat_acquired (struct lock *lock, uint64_t wait_start)
+{
+  struct lockstat *s = lock->stat;
+  enum intr_level old_level = intr_disable ();
+
+  lock->acquired = timer_ns ();
+  if (s != NULL)
+    {
+      s->acquisitions++;
+      if (wait_start != 0)
+        {
+          uint64_t wait = lock->acquired - wait_start;
+          s->contentions++;
+          s->wait_total += wait;
+          if (wait > s->wait_max)
+            s->wait_max = wait;
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread is releasing LOCK. */
+static void
+lockstat_released (struct lock *lock)
+{
+  struct lockstat *s = lock->stat;
+  enum intr_level old_level = intr_disable ();
+
+  if (s != NULL)
+    {
+      uint64_t hold = timer_ns () - lock->acquired;
+      s->hold_total += hold;
+      if (hold > s->hold_max)
+        s->hold_max = hold;
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns true if site A has seen more contention than B. */
+static bool
+lockstat_more_contended (const struct lockstat *a, const struct lockstat *b)
+{
+  if (a->contentions != b->contentions)
+    return a->contentions > b->contentions;
+  return a->wait_total > b->wait_total;
+}
+
+/* Prints the lock initialization sites that have seen the most
+   contention, with their wait and hold times in microseconds. */
+void
+lockstat_print (void)
+{
+  struct lockstat *top[LOCKSTAT_TOP];
+  struct lockstat *s;
+  size_t top_cnt = 0;
+  size_t site_cnt = 0;
+  size_t i;
+  enum intr_level old_level = intr_disable ();
+
+  for (s = lockstat_sites; s != NULL; s = s->next)
+    {
+      site_cnt++;
+      if (s->acquisitions == 0)
+        continue;
+      for (i = top_cnt; i > 0 && lockstat_more_contended (s, top[i - 1]);
+           i--)
+        if (i < LOCKSTAT_TOP)
+          top[i] = top[i - 1];
+      if (i < LOCKSTAT_TOP)
+        {
+          top[i] = s;
+          if (top_cnt < LOCKSTAT_TOP)
+            top_cnt++;
+        }
+    }
+  intr_set_level (old_level);
+
+  printf ("lockstat: %zu lock sites, most contended first\n", site_cnt);
+  printf ("%10s %10s %10s %10s %10s %10s  %s\n", "acquired", "contended",
+          "wait avg", "wait max", "hold avg", "hold max", "lock");
+  for (i = 0; i < top_cnt; i++)
+    {
+      s = top[i];
+      printf ("%10lld %10lld %10llu %10llu %10llu %10llu  %s (%s:%d)\n",
+              s->acquisitions, s->contentions,
+              s->contentions ? s->wait_total / s->contentions / 1000 : 0,
+              s->wait_max / 1000,
+              s->hold_total / s->acquisitions / 1000,
+              s->hold_max / 1000,
+              s->name, s->file, s->line);
+    }
+}
+
+/* Zeros the statistics of every lock initialization site, for
+   example between the phases of a benchmark. */
+void
+lockstat_reset (void)
+{
+  enum intr_level old_level = intr_disable ();
+  struct lockstat *s;
+
+  for (s = lockstat_sites; s != NULL; s = s->next)
+    {
+      s->acquisitions = s->contentions = 0;
+      s->wait_total = s->wait_max = 0;
+      s->hold_total = s->hold_max = 0;
+    }
+  intr_set_level (old_level);
+}
+#else /* !LOCKSTAT */
+void
+lockstat_print (void)
+{
+  printf ("lockstat: not available, rebuild with -DLOCKSTAT\n");
+}
+
+void
+lockstat_reset (void)
+{
+}
+#endif /* !LOCKSTAT */
+
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -361,7 +695,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  wait_queue_init (&cond->waiters);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -388,6 +722,8 @@ void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
   struct semaphore_elem waiter;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -395,9 +731,14 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_front (&cond->waiters, &waiter.elem);
+  waiter.elem.queue = NULL;
+  old_level = intr_disable ();
+  wait_queue_push (&cond->waiters, &waiter.elem, cur->priority);
+  cur->cond_elem = &waiter.elem;
+  intr_set_level (old_level);
   lock_release (lock);
   sema_down (&waiter.semaphore);
+  cur->cond_elem = NULL;
   lock_acquire (lock);
 }
 
@@ -411,17 +752,24 @@ cond_wait (struct condition *cond, struct lock *lock)
 void
 cond_signal (struct condition *cond, struct lock *lock UNUSED) 
 {
+  struct semaphore_elem *waiter = NULL;
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters))
-  {   
-      list_sort (&cond->waiters, cond_less, NULL);
-      sema_up (&list_entry (list_pop_back (&cond->waiters),
-                            struct semaphore_elem, elem)->semaphore);
-  }
+  /* Priority donation can reorder COND's waiters from another
+     thread, so they are only modified with interrupts off. */
+  old_level = intr_disable ();
+  if (!wait_queue_empty (&cond->waiters))
+    waiter = wait_queue_entry (wait_queue_pop (&cond->waiters),
+                               struct semaphore_elem, elem);
+  intr_set_level (old_level);
+
+  if (waiter != NULL)
+    sema_up (&waiter->semaphore);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -436,6 +784,6 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!wait_queue_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
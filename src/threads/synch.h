@@ -2,12 +2,54 @@
 #define THREADS_SYNCH_H
 #include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct thread;
+struct wait_queue;
+
+/* An element in a wait queue. */
+struct wait_elem
+  {
+    struct wait_queue *queue;   /* Queue containing this, or null. */
+    struct wait_elem *child;    /* First child. */
+    struct wait_elem *next;     /* Next sibling. */
+    struct wait_elem *prev;     /* Previous sibling, or parent. */
+    int key;                    /* Priority. */
+    unsigned seq;               /* Order of insertion. */
+  };
+
+/* A priority queue of waiters: highest key first, and among
+   equal keys, first in first out.  Implemented as a pairing
+   heap, so that inserting takes O(1) time and removing the
+   maximum, removing an arbitrary element, or changing an
+   element's key take O(log n) amortized time. */
+struct wait_queue
+  {
+    struct wait_elem *root;     /* Maximum element, or null. */
+    unsigned seq;               /* Next insertion number. */
+  };
+
+/* Converts pointer to wait queue element WAIT_ELEM into a
+   pointer to the structure that WAIT_ELEM is embedded inside.
+   See list_entry() in list.h. */
+#define wait_queue_entry(WAIT_ELEM, STRUCT, MEMBER)             \
+        ((STRUCT *) ((uint8_t *) (WAIT_ELEM)                    \
+                     - offsetof (STRUCT, MEMBER)))
+
+void wait_queue_init (struct wait_queue *);
+bool wait_queue_empty (const struct wait_queue *);
+void wait_queue_push (struct wait_queue *, struct wait_elem *, int key);
+struct wait_elem *wait_queue_max (const struct wait_queue *);
+struct wait_elem *wait_queue_pop (struct wait_queue *);
+void wait_queue_remove (struct wait_elem *);
+void wait_queue_rekey (struct wait_elem *, int key);
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct wait_queue waiters;  /* Waiting threads, by priority. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -15,44 +57,81 @@ void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_broadcast (struct semaphore *);
+void sema_priority_changed (struct thread *);
 void sema_self_test (void);
 
+#ifdef LOCKSTAT
+/* Contention statistics for all the locks initialized at one
+   place in the source.  Kept only in kernels built with
+   -DLOCKSTAT.  Times are in nanoseconds. */
+struct lockstat
+  {
+    const char *name;           /* Argument to lock_init(). */
+    const char *file;           /* Source file of lock_init() call. */
+    int line;                   /* Line of lock_init() call. */
+    struct lockstat *next;      /* Next initialization site. */
+    bool registered;            /* Linked into the list of sites? */
+    long long acquisitions;     /* Times acquired. */
+    long long contentions;      /* Times acquired after waiting. */
+    uint64_t wait_total;        /* Total time spent waiting. */
+    uint64_t wait_max;          /* Longest wait. */
+    uint64_t hold_total;        /* Total time held. */
+    uint64_t hold_max;          /* Longest hold. */
+  };
+#endif
+
 /* Lock. */
 struct lock 
   {
     int id;			/* Lock identifier. */
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
+#ifdef LOCKSTAT
+    struct lockstat *stat;      /* Statistics for the init site. */
+    uint64_t acquired;          /* When the holder acquired it. */
+#endif
   };
 
-/* One lock in a list */
-struct lock_elem
-  {
-    struct lock *lock;          /* This lock */
-    struct list_elem elem;      /* List element */
-    int id;			/* Lock identifier. */
-  };
-
-struct list lock_list;
-
 void lock_init (struct lock *);
 bool lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
-void lock_update (struct lock *, bool);
 bool lock_held_by_current_thread (const struct lock *);
 
-/* One semaphore in a list */
+void lockstat_print (void);
+void lockstat_reset (void);
+
+#ifdef LOCKSTAT
+void lockstat_register (struct lock *, struct lockstat *);
+
+/* Initializes LOCK and charges its statistics to this
+   particular call site. */
+#define lock_init(LOCK)                                                 \
+        do                                                              \
+          {                                                             \
+            static struct lockstat lockstat_site_                       \
+              = { #LOCK, __FILE__, __LINE__, NULL, false,               \
+                  0, 0, 0, 0, 0, 0 };                                   \
+            struct lock *lockstat_lock_ = (LOCK);                       \
+                                                                        \
+            lock_init (lockstat_lock_);                                 \
+            lockstat_register (lockstat_lock_, &lockstat_site_);        \
+          }                                                             \
+        while (0)
+#endif
+
+/* One semaphore in a wait queue */
 struct semaphore_elem
   {
-    struct list_elem elem;       /* List element */
+    struct wait_elem elem;       /* Wait queue element */
     struct semaphore semaphore;  /* This semaphore */
   };
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct wait_queue waiters;  /* Waiting threads, by priority. */
   };
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
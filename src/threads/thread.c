@@ -13,6 +13,7 @@
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
 #include "threads/deadlock.h"
+#include "threads/trace.h"
 
 #ifdef USERPROG
 int userprog = 1;
@@ -25,9 +26,15 @@ int userprog = 0;
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Scheduling classes, from highest rank to lowest.  Processes
+   in THREAD_READY state, that is, processes that are ready to
+   run but not actually running, are kept in the run queue of
+   their class.  See sched.h. */
+static const struct sched_class *const sched_classes[] =
+  {&sched_prio, &sched_mlfqs, &sched_fair};
+#define SCHED_CLASS_CNT (sizeof sched_classes / sizeof *sched_classes)
+
+static size_t ready_cnt;        /* # of threads in run queues. */
 
 /* Idle thread. */
 static struct thread *idle_thread;
@@ -35,9 +42,14 @@ static struct thread *idle_thread;
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
+/* Lock used by allocate_tid() and for tid_table. */
 static struct lock tid_lock;
 
+/* Index of the threads in thread_list by tid. */
+static struct hash tid_table;
+static hash_hash_func tid_hash;
+static hash_less_func tid_less;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -46,22 +58,32 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
+/* Pages of exited threads, kept for reuse by thread_create() so
+   that creating a thread does not go through the page allocator
+   or zero a whole page.  Each page begins with a struct
+   thread_page.  Access with interrupts off. */
+struct thread_page
+  {
+    struct thread_page *next;   /* Next cached page. */
+  };
+static struct thread_page *page_cache;
+static size_t page_cache_cnt;   /* # of pages in page_cache. */
+#define PAGE_CACHE_MAX 16       /* Most pages page_cache keeps. */
+
 /* Statistics. */
+static long long create_cnt;    /* # of threads created. */
+static long long cache_hits;    /* # of them created from page_cache. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
-/* If false (default), use round-robin scheduler.
-   If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
-bool thread_mlfqs;
-
-/* 17.14 Fixed Point Arithmetic factor. */
-int f = 1 << 14;
+/* Scheduling class of the initial thread, and so by inheritance
+   of every thread unless changed.  Controlled by kernel
+   command-line options "-sched=CLASS" and "-mlfqs". */
+const struct sched_class *thread_default_class = &sched_prio;
 
 static void kernel_thread (thread_func *, void *aux);
 
@@ -71,11 +93,16 @@ static struct thread * next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static struct thread *alloc_thread_page (void);
+static void free_thread_page (struct thread *);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
-bool priority_inversion (void);
-void donate_priority (void);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static void thread_change_priority (struct thread *, int priority);
+static bool preempts (struct thread *t, struct thread *cur);
+static size_t class_rank (const struct sched_class *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -95,9 +122,12 @@ thread_init (void)
 {
   ASSERT (intr_get_level () == INTR_OFF);
 
+  size_t i;
+
   lock_init (&tid_lock);
-  list_init (&lock_list);
-  list_init (&ready_list);
+  for (i = 0; i < SCHED_CLASS_CNT; i++)
+    sched_classes[i]->init ();
+  ready_cnt = 0;
   list_init (&thread_list);
   
 /* Set up a thread structure for the running thread. */
@@ -107,6 +137,8 @@ thread_init (void)
   initial_thread->tid = allocate_tid ();
   initial_thread->nice = 0;  
   initial_thread->recent_cpu = 0;  
+  initial_thread->sched_class = thread_default_class;
+  thread_default_class->attach (initial_thread);
  }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -114,16 +146,20 @@ thread_init (void)
 void
 thread_start (void) 
 {
-  /* Insert into thread list. */
-  struct thread_elem *t_elem = (struct thread_elem *) 
-                                malloc (sizeof (struct thread_elem)); 
-  t_elem->t = initial_thread;
-  list_push_back (&thread_list, &t_elem->elem);
-
-  /* Create the idle thread. */
+  /* Insert into thread list and tid index. */
+  list_push_back (&thread_list, &initial_thread->allelem);
+  if (!hash_init (&tid_table, tid_hash, tid_less, NULL))
+    PANIC ("out of memory for tid table");
+  hash_insert (&tid_table, &initial_thread->tid_elem);
+
+  /* Create the idle thread.  It is created in the priority
+     scheduler's class, whatever ours is, so that it runs once
+     at the lowest priority to set itself up. */
   struct semaphore idle_started;
   sema_init (&idle_started, 0);
+  initial_thread->sched_class = &sched_prio;
   thread_create ("idle", 0 , idle, &idle_started);
+  initial_thread->sched_class = thread_default_class;
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
@@ -138,7 +174,10 @@ void
 thread_tick (void) 
 { 
   struct thread *t = thread_current ();
-  struct list_elem *e;
+  struct thread *next;
+  bool resched = false;
+  size_t i;
+
   /* Update statistics. */
   if (t == idle_thread)
     idle_ticks++;
@@ -151,45 +190,21 @@ thread_tick (void)
 
   thread_ticks++;
 
-  if (thread_mlfqs)
+  /* Let every class do its bookkeeping, and the running thread's
+     class decide whether its time is up. */
+  for (i = 0; i < SCHED_CLASS_CNT; i++)
+    if (sched_classes[i]->tick (t != idle_thread ? t : NULL, thread_ticks))
+      resched = true;
+
+  /* Also yield to any ready thread of a higher-ranked class. */
+  next = next_thread_to_run ();
+  if (next != idle_thread
+      && (resched || t == idle_thread
+          || class_rank (next->sched_class) < class_rank (t->sched_class)))
    {
-     t->recent_cpu += f * (t != idle_thread);
-    
-     if (!(timer_ticks () % TIMER_FREQ))
-      {
-        int ready_threads = list_size (&ready_list) + (t != idle_thread);
-        load_average = (((59*f/60) * load_average) 
-                      + (( 1*f/60) * ready_threads * f))/f;
-        int64_t quotient = (2*load_average*f) / (2*load_average + 1*f);
-        for (e = list_begin (&thread_list); e != list_end (&thread_list);
-             e = list_next (e))
-        {
-           struct thread *t = list_entry (e, struct thread_elem, elem)->t;
-           t->recent_cpu = (quotient * t->recent_cpu)/f + (t->nice * f);
-        }
-      }
-
-     if (!(timer_ticks () % 4))
-      {
-        for (e = list_begin (&thread_list); e != list_end (&thread_list);
-             e = list_next (e))
-         {
-           struct thread *t = list_entry (e, struct thread_elem, elem)->t;
-           int new_priority = PRI_MAX - (t->recent_cpu / (4*f)) 
-                              - (t->nice * 2);
-           if (new_priority < PRI_MIN) new_priority = PRI_MIN;
-           if (new_priority > PRI_MAX) new_priority = PRI_MAX;
-           t->old_priority = new_priority;
-           t->priority = new_priority;
-         }
-      }
+     TRACE (TRACE_PREEMPT, t, next, next->priority);
+     intr_yield_on_return ();
    }
-  struct thread *next = next_thread_to_run ();
-  if (t->priority < next->priority ||
-     ((t->priority == next->priority) &&
-      (thread_ticks > TIME_SLICE)) || 
-      (next == idle_thread))
-          intr_yield_on_return ();
 }
 
 /* Prints thread statistics. */
@@ -198,6 +213,8 @@ thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld threads created, %lld from cached pages\n",
+          create_cnt, cache_hits);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -223,29 +240,30 @@ thread_create (const char *name, int priority,
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
   tid_t tid;
 
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = alloc_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
-  t->current_directory = thread_current ()->current_directory;
+  t->current_directory = cur->current_directory;
 
-  /* Inherit niceness and recent cpu time */
-  if (thread_mlfqs && tid != 2)
-   {
-      struct thread *cur = thread_current ();
-      t->nice = cur->nice;
-      t->recent_cpu = cur->recent_cpu;
-      t->priority = PRI_MAX - (t->recent_cpu / (4*f)) - (t->nice * 2);
-      t->old_priority = t->priority;
-   }
+  /* Inherit scheduling class, niceness and recent cpu time. */
+  old_level = intr_disable ();
+  t->sched_class = cur->sched_class;
+  t->nice = cur->nice;
+  t->recent_cpu = cur->recent_cpu;
+  t->decay_epoch = cur->decay_epoch;
+  t->sched_class->attach (t);
+  intr_set_level (old_level);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -261,13 +279,15 @@ thread_create (const char *name, int priority,
   sf = alloc_frame (t, sizeof *sf);
   sf->eip = switch_entry;
 
-  /* Inserting into thread_list. */
+  /* Inserting into thread_list and the tid index. */
   if (tid != 2)
    {
-     struct thread_elem *t_elem = (struct thread_elem *) 
-                                   malloc (sizeof (struct thread_elem)); 
-     t_elem->t = t;
-     list_push_back (&thread_list, &t_elem->elem);
+     lock_acquire (&tid_lock);
+     hash_insert (&tid_table, &t->tid_elem);
+     lock_release (&tid_lock);
+     old_level = intr_disable ();
+     list_push_back (&thread_list, &t->allelem);
+     intr_set_level (old_level);
    }
 
 #ifdef USERPROG
@@ -275,10 +295,8 @@ if (userprog)
 {
    /* Add the newly spawned child to the 
       current thread's list of children. */
-   struct child *child = (struct child *) malloc (sizeof (struct child)); 
-   child->thread = t;
-   struct thread *cur = thread_current ();
-   list_push_back (&cur->children, &child->elem);
+   t->parent = cur;
+   list_push_back (&cur->children, &t->child_elem);
 }
 #endif
 
@@ -313,6 +331,8 @@ thread_block (void)
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
+  TRACE (TRACE_BLOCK, thread_current (), NULL, thread_current ()->priority);
+  thread_current ()->sched_class->yield (thread_current ());
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -328,10 +348,10 @@ thread_unblock (struct thread *t)
   ASSERT (is_thread (t));
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_insert_ordered (&ready_list, &t->elem, priority_less, NULL);
   t->status = THREAD_READY;
-  if ((thread_current()->priority < t->priority) &&
-      thread_current() != idle_thread)
+  ready_push (t);
+  TRACE (TRACE_WAKEUP, t, running_thread (), t->priority);
+  if (thread_current () != idle_thread && preempts (t, thread_current ()))
    {
      if (intr_context ())
         intr_yield_on_return ();
@@ -382,37 +402,26 @@ thread_exit (void)
   ASSERT (!intr_context ());
 
   /* Release any locks held by the thread. */
-  struct list_elem *e;
   struct thread *cur = thread_current ();
-  for (e = list_begin (&lock_list); e != list_end (&lock_list);
-       e = list_next (e))
-    {
-      struct lock *lock = list_entry (e, struct lock_elem, elem)->lock;
-      struct thread *holder = lock->holder;
-      if (holder == cur)
-         lock_release (lock);
-    }
+  while (!list_empty (&cur->held_locks))
+    lock_release (list_entry (list_front (&cur->held_locks), 
+                              struct lock, elem));
 
 #ifdef USERPROG
   process_exit ();
 #endif
 
+  lock_acquire (&tid_lock);
+  hash_delete (&tid_table, &cur->tid_elem);
+  lock_release (&tid_lock);
+
   /* Just set our status to dying and schedule another process.
      We will be destroyed during the call to schedule_tail(). */
   intr_disable ();
+  cur->sched_class->yield (cur);
+  cur->sched_class->detach (cur);
 
-  /* Remove thread_elem from thread_list. */
-  for (e = list_begin (&thread_list); e != list_end (&thread_list);
-       e = list_next (e))
-    {
-      struct thread_elem *t_elem = list_entry (e, struct thread_elem, elem);
-      if (t_elem->t == cur)
-       {
-         list_remove (e);
-         free (t_elem);
-         break;
-       }
-    }
+  list_remove (&cur->allelem);
   cur->status = THREAD_DYING;
    
   schedule ();
@@ -429,9 +438,12 @@ thread_yield (void)
   
   ASSERT (!intr_context ());
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_insert_ordered (&ready_list, &cur->elem, priority_less, NULL);
   cur->status = THREAD_READY;
+  if (cur != idle_thread) 
+    {
+      cur->sched_class->yield (cur);
+      ready_push (cur);
+    }
   schedule ();
   intr_set_level (old_level);
 }
@@ -441,11 +453,18 @@ void
 thread_set_priority (int new_priority) 
 {
   struct thread *cur = thread_current ();
-  if (cur->priority == cur->old_priority)
-     cur->priority = new_priority;
-  cur->old_priority = new_priority;
-  if (cur->priority < next_thread_to_run()->priority)
-  thread_yield ();
+  enum intr_level old_level = intr_disable ();
+  bool yield;
+
+  if (cur->sched_class->priority)
+   {
+     cur->old_priority = new_priority;
+     thread_update_priority (cur);
+   }
+  yield = preempts (next_thread_to_run (), cur);
+  intr_set_level (old_level);
+  if (yield)
+    thread_yield ();
 }
 
 /* Returns the current thread's priority. */
@@ -457,18 +476,18 @@ thread_get_priority (void)
 
 /* Sets the current thread's nice value to NICE. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
+  struct thread *cur = thread_current ();
   enum intr_level old_level = intr_disable ();
-  struct thread *cur = thread_current();
-  if (cur == idle_thread) return;
+  bool yield;
+
   cur->nice = nice;
-  int new_priority = PRI_MAX - (cur->recent_cpu / (4*f)) 
-                     - (cur->nice * 2);
-  if (new_priority < PRI_MIN) new_priority = PRI_MIN;
-  if (new_priority > PRI_MAX) new_priority = PRI_MAX;
-  thread_set_priority (new_priority);
+  cur->sched_class->reweight (cur);
+  yield = preempts (next_thread_to_run (), cur);
   intr_set_level (old_level);
+  if (yield)
+    thread_yield ();
 }
 
 /* Returns the current thread's nice value. */
@@ -478,18 +497,51 @@ thread_get_nice (void)
   return thread_current()->nice;
 }
 
-/* Returns 100 times the system load average. */
-int
-thread_get_load_avg (void) 
+/* Moves the current thread to scheduling class CLASS.  Threads
+   it creates afterward start out in CLASS too. */
+void
+thread_set_sched_class (const struct sched_class *class)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool yield;
+
+  ASSERT (class != NULL);
+  ASSERT (cur != idle_thread);
+
+  old_level = intr_disable ();
+  if (cur->sched_class != class)
+    {
+      cur->sched_class->yield (cur);
+      cur->sched_class->detach (cur);
+      cur->sched_class = class;
+      class->attach (cur);
+    }
+  yield = preempts (next_thread_to_run (), cur);
+  intr_set_level (old_level);
+  if (yield)
+    thread_yield ();
+}
+
+/* Returns the number of threads that are ready to run, not
+   counting the running thread. */
+size_t
+thread_ready_cnt (void)
 {
-  return (100 * load_average/f);
+  return ready_cnt;
 }
 
-/* Returns 100 times the current thread's recent_cpu value. */
-int
-thread_get_recent_cpu (void) 
+/* Returns the scheduling class named NAME, or a null pointer if
+   there is none. */
+const struct sched_class *
+sched_find (const char *name)
 {
-  return (100 * thread_current()->recent_cpu / f);
+  size_t i;
+
+  for (i = 0; i < SCHED_CLASS_CNT; i++)
+    if (!strcmp (sched_classes[i]->name, name))
+      return sched_classes[i];
+  return NULL;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -513,6 +565,19 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nothing else can run, so zero free pages for later
+         PAL_ZERO requests, one at a time, until there is no more
+         to do or a thread wakes up. */
+      intr_enable ();
+      while (thread_ready_cnt () == 0 && palloc_prezero ())
+        continue;
+      intr_disable ();
+      if (thread_ready_cnt () > 0)
+        continue;
+
+      /* Stop the timer tick until there is something to do. */
+      timer_idle ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -576,6 +641,7 @@ init_thread (struct thread *t, const char *name, int priority)
   t->magic = THREAD_MAGIC;
   t->priority = priority;
   t->old_priority = priority;
+  list_init (&t->held_locks);
 
 #ifdef USERPROG
   list_init (&t->fd_list);
@@ -593,9 +659,54 @@ alloc_frame (struct thread *t, size_t size)
   ASSERT (is_thread (t));
   ASSERT (size % sizeof (uint32_t) == 0);
   t->stack -= size;
+  memset (t->stack, 0, size);
   return t->stack;
 }
 
+/* Returns a page for a new thread, or a null pointer if memory
+   is exhausted.  Only the parts of the page that init_thread()
+   and alloc_frame() initialize are ever read, so the page is not
+   zeroed. */
+static struct thread *
+alloc_thread_page (void)
+{
+  struct thread_page *page;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  create_cnt++;
+  page = page_cache;
+  if (page != NULL)
+    {
+      page_cache = page->next;
+      page_cache_cnt--;
+      cache_hits++;
+    }
+  intr_set_level (old_level);
+
+  if (page == NULL)
+    page = palloc_get_page (0);
+  return (struct thread *) page;
+}
+
+/* Frees T's page, or keeps it for a later thread_create().
+   Interrupts must be off. */
+static void
+free_thread_page (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (page_cache_cnt < PAGE_CACHE_MAX)
+    {
+      struct thread_page *page = (struct thread_page *) t;
+      page->next = page_cache;
+      page_cache = page;
+      page_cache_cnt++;
+    }
+  else
+    palloc_free_page (t);
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
@@ -604,13 +715,95 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  size_t i;
+
+  for (i = 0; i < SCHED_CLASS_CNT; i++)
+    {
+      struct thread *t = sched_classes[i]->pick_next ();
+      if (t != NULL)
+        return t;
+    }
+  return idle_thread;
+}
+
+/* Returns the rank of CLASS in sched_classes[], where 0 is the
+   highest rank. */
+static size_t
+class_rank (const struct sched_class *class)
+{
+  size_t i;
+
+  for (i = 0; i < SCHED_CLASS_CNT; i++)
+    if (sched_classes[i] == class)
+      break;
+  ASSERT (i < SCHED_CLASS_CNT);
+  return i;
+}
+
+/* Returns true if ready thread T should preempt running thread
+   CUR: if T's class outranks CUR's, or if they are in the same
+   class and the class says so. */
+static bool
+preempts (struct thread *t, struct thread *cur)
+{
+  size_t t_rank, cur_rank;
+
+  if (t == idle_thread)
+    return false;
+  t_rank = class_rank (t->sched_class);
+  cur_rank = class_rank (cur->sched_class);
+  return (t_rank < cur_rank
+          || (t_rank == cur_rank && t->sched_class->preempt (cur, t)));
+}
+
+/* Adds ready thread T to its class's run queue.  Interrupts
+   must be off. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  t->sched_class->enqueue (t);
+  ready_cnt++;
+}
+
+/* Removes T from its class's run queue.  Interrupts must be
+   off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->sched_class->dequeue (t);
+  ready_cnt--;
+}
+
+/* Sets T's effective priority to PRIORITY.  If T is ready to
+   run and its class schedules by priority, moves T to the back
+   of the matching run queue, as if it had just been
+   unblocked.  If T is blocked, reorders the wait queues it is
+   on. */
+static void
+thread_change_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (t->status == THREAD_READY && t != idle_thread
+      && t->sched_class->priority && t->priority != priority)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else if (t->status == THREAD_BLOCKED && t->priority != priority)
+    {
+      t->priority = priority;
+      sema_priority_changed (t);
+    }
   else
-   { 
-     struct list_elem *ready_e = list_max (&ready_list, priority_less, NULL);
-     return list_entry (ready_e, struct thread, elem);
-   }
+    t->priority = priority;
+  intr_set_level (old_level);
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -656,7 +849,7 @@ schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      free_thread_page (prev);
     }
 }
 
@@ -670,8 +863,6 @@ schedule_tail (struct thread *prev)
 static void
 schedule (void) 
 {
-  if (!thread_mlfqs && priority_inversion ())
-      donate_priority ();
   struct thread *cur = running_thread ();
   struct thread *next = next_thread_to_run ();
   struct thread *prev = NULL;
@@ -679,13 +870,51 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
-  list_remove (&next->elem);
+  if (next != idle_thread)
+    ready_remove (next);
   if (cur != next)
+   {
+     TRACE (TRACE_SWITCH, cur, next, next->priority);
      prev = switch_threads (cur, next);
+   }
 
   schedule_tail (prev);
 }
 
+/* Returns the live thread with the given TID, or a null pointer
+   if there is none.  The idle thread is never found.  Nothing
+   prevents the thread from exiting once this function returns,
+   so the caller must know by other means that it cannot. */
+struct thread *
+thread_find (tid_t tid)
+{
+  struct thread key;
+  struct hash_elem *e;
+
+  key.tid = tid;
+  lock_acquire (&tid_lock);
+  e = hash_find (&tid_table, &key.tid_elem);
+  lock_release (&tid_lock);
+  return e != NULL ? hash_entry (e, struct thread, tid_elem) : NULL;
+}
+
+/* Returns a hash value for the thread containing E. */
+static unsigned
+tid_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct thread, tid_elem)->tid);
+}
+
+/* Returns true if the thread containing A has a lower tid than
+   the thread containing B. */
+static bool
+tid_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return (hash_entry (a, struct thread, tid_elem)->tid
+          < hash_entry (b, struct thread, tid_elem)->tid);
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
@@ -704,103 +933,56 @@ allocate_tid (void)
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-/* Implements priority donation */
+/* Donates T's priority along the chain of lock holders that T
+   is waiting behind: the holder of T->waiting_lock, the holder
+   of the lock that holder is waiting on, and so on.  Stops as
+   soon as a holder already runs at T's priority or better, or
+   is in a scheduling class that does not schedule by priority,
+   so the walk is bounded by the length of the chain.  Interrupts
+   must be off. */
 void
-donate_priority (void)
-{ 
-  list_sort (&lock_list, lock_less, NULL);
-  struct list_elem *e;
-  for (e = list_rbegin (&lock_list); e != list_rend (&lock_list);
-       e = list_prev (e))
+thread_donate_priority (struct thread *t)
+{
+  struct lock *lock = t->waiting_lock;
+  int priority = t->priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (lock != NULL && lock->holder != NULL 
+         && lock->holder->sched_class->priority
+         && lock->holder->priority < priority)
     {
-      struct lock_elem *lock_e = list_entry (e, struct lock_elem, elem);
-      struct thread *holder = lock_e->lock->holder;
-      if (holder == NULL)
-         continue;
-      struct list_elem *max_e = list_rbegin (&lock_e->lock->semaphore.waiters);
-      struct thread *max_waiter = list_entry (max_e, struct thread, elem);
-      if (max_waiter == NULL)
-         continue;
-      if (holder->priority < max_waiter->priority)
-         holder->priority = max_waiter->priority;
+      struct thread *holder = lock->holder;
+      TRACE (TRACE_DONATE, holder, t, priority);
+      thread_change_priority (holder, priority);
+      lock = holder->waiting_lock;
     }
 }
 
-/* Returns true if priority inversion has occurred */
-bool
-priority_inversion (void)
+/* Recomputes T's effective priority as the larger of its base
+   priority and the priority of the highest-priority thread
+   waiting on any lock T holds.  Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
 {
-  struct list_elem *e = list_begin (&lock_list);
+  int priority = t->old_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
 
-  for (e = list_begin (&lock_list); e != list_end (&lock_list); 
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
        e = list_next (e))
     {
-      struct lock_elem *lock_e = list_entry (e, struct lock_elem, elem);
-      struct thread *holder = lock_e->lock->holder;
-
-      if (holder == NULL)
-         continue;
-
-      if (list_empty (&lock_e->lock->semaphore.waiters))
-         continue;
-
-      struct list_elem *max_e = list_max (&lock_e->lock->semaphore.waiters, 
-                                          priority_less, NULL);
-      struct thread *max_waiter = list_entry (max_e, struct thread, elem);
-
-      if (max_waiter == NULL)
-         continue;
-
-      if (holder->priority < max_waiter->priority)
-         return true;
-     }
-   return false;
-}
-
-bool 
-priority_less (const struct list_elem *a,
-               const struct list_elem *b,
-               void *aux UNUSED)
-{ 
-  int ap = list_entry (a, struct thread, elem)->priority;
-  int bp = list_entry (b, struct thread, elem)->priority;
-  if (ap < bp) return true;
-  return false;
-}
-
-bool 
-lock_less (const struct list_elem *a,
-           const struct list_elem *b,
-           void *aux UNUSED)
-{ 
-  struct thread *ah = list_entry (a, struct lock_elem, elem)->lock->holder;
-  struct thread *bh = list_entry (b, struct lock_elem, elem)->lock->holder;
-  int ap, bp;
-  if (ah == NULL) 
-     ap = 0;
-  else
-     ap = ah->priority;
-  if (bh == NULL) 
-     bp = 0;
-  else
-     bp = bh->priority;
-  if (ap < bp) return true;
-  return false;
-}
-
-bool
-cond_less (const struct list_elem *a,
-           const struct list_elem *b,
-           void *aux UNUSED)
-{
-  struct semaphore *as = &list_entry (a, struct semaphore_elem, elem)
-                                                              ->semaphore;
-  struct semaphore *bs = &list_entry (b, struct semaphore_elem, elem)
-                                                              ->semaphore;
-  int ap = list_entry (list_begin (&as->waiters) , struct thread, elem)
-                                                              ->priority;
-  int bp = list_entry (list_begin (&bs->waiters) , struct thread, elem)
-                                                              ->priority;
-  if (ap < bp) return true;
-  return false;
+      struct wait_queue *waiters = &list_entry (e, struct lock, elem)
+                                                 ->semaphore.waiters;
+      if (!wait_queue_empty (waiters))
+       {
+         struct thread *max_waiter
+           = wait_queue_entry (wait_queue_max (waiters), struct thread,
+                               wait_elem);
+         if (max_waiter->priority > priority)
+            priority = max_waiter->priority;
+       }
+    }
+  thread_change_priority (t, priority);
 }
@@ -2,8 +2,10 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/sched.h"
 #include "threads/synch.h"
 #include "devices/timer.h"
 
@@ -82,12 +84,12 @@ typedef int tid_t;
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
 
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in the run queue of the
+   thread's scheduling class.  A blocked thread waits in a
+   semaphore's wait queue through `wait_elem' instead, and,
+   while it waits on a condition variable, is also represented in
+   the condition's wait queue by `cond_elem', so that both queues
+   can be reordered when priority donation changes its priority. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -98,15 +100,34 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int old_priority;                   /* Priority before donation. */
     int priority;                       /* Priority. */
-    /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
+    struct lock *waiting_lock;          /* Lock this thread is blocked on,
+                                           if any. */
+    struct list held_locks;             /* Locks held by this thread. */
+    struct list_elem allelem;           /* Element in thread_list. */
+    struct hash_elem tid_elem;          /* Element in tid index. */
+    const struct sched_class *sched_class;  /* Scheduling class. */
+    /* Owned by the scheduling class. */
+    struct list_elem class_elem;        /* Element in class's list. */
+    struct fair_node fair_node;         /* Fair class run queue node. */
+    uint64_t vruntime;                  /* Fair class virtual runtime. */
+    uint64_t exec_start;                /* Fair class: last charged, ns. */
+    struct list_elem elem;              /* Run queue element. */
+    /* Owned by synch.c. */
+    struct wait_elem wait_elem;         /* Semaphore wait queue element. */
+    struct wait_elem *cond_elem;        /* Condition wait queue element,
+                                           if waiting on one. */
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_time;                /* Tick to wake up at. */
+    struct list_elem sleep_elem;        /* Timer wheel element. */
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
     int user_stack_size;                /* Size of the user stack. 
                                            Initial size = 4KB. Can grow
                                            upto STACK_LIMIT (8MB). */
-    struct list children;               /* List of children. */
+    struct thread *parent;              /* Parent, until it waits. */
+    struct list children;               /* Children not yet waited for. */
+    struct list_elem child_elem;        /* Element in parent's children. */
     struct semaphore wait;		/* Semaphore for signalling 
 					   waiting parent. */
     struct semaphore zombie;		/* Semaphore for waiting for 
@@ -122,33 +143,25 @@ struct thread
                                            A status of 0 indicates success
                                            and nonzero indicates errors. */
     struct list fd_list;                /* List of file descriptor elements. */
+#endif
+#ifdef VM
+    /* Owned by vm/frame.c. */
+    struct hash pages;                  /* Supplemental page table. */
 #endif
     int64_t nice;                       /* Niceness. */
     int64_t recent_cpu;                 /* Recent CPU Time. */
+    unsigned decay_epoch;               /* Last recent_cpu decay applied. */
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
     struct dir *current_directory;      /* Current working directory for this
                                            thread. */
   };
 
-/* One thread in a list of all alive threads. */
-struct thread_elem
-  {
-    struct thread *t;			/* This thread. */
-    struct list_elem elem;              /* List element. */
-  };
-
-/* List of all threads that are alive. */
+/* List of all threads that are alive, except the idle thread,
+   linked through their `allelem' members. */
 struct list thread_list;
 
 #ifdef USERPROG
-/* One child in a list of children. */
-struct child
-  {
-    struct thread *thread;		/* This thread. */
-    struct list_elem elem;		/* List element. */
-  };
-
 struct file_desc
  {
    int fd;				/* File Descriptor. */
@@ -157,14 +170,22 @@ struct file_desc
  };
 #endif
 
-/* If false (default), use round-robin scheduler.
-   If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
-extern bool thread_mlfqs;
+/* True if the running thread is scheduled by the multi-level
+   feedback queue scheduler, false otherwise.  Threads inherit
+   their creator's scheduling class; the initial thread's class
+   is set by kernel command-line option "-sched=CLASS" (or
+   "-mlfqs"), and a thread can change its own class with
+   thread_set_sched_class(). */
+#define thread_mlfqs (thread_current ()->sched_class == &sched_mlfqs)
 
-/* Estimate of the average number of
-   threads ready to run over the past minute. */
-static int64_t load_average = 0;  
+/* Scheduling class of the initial thread.  Controlled by kernel
+   command-line options "-sched=CLASS" and "-mlfqs". */
+extern const struct sched_class *thread_default_class;
+
+/* Estimate of the average number of threads ready to run over
+   the past minute, as a 17.14 fixed-point number.  Owned by
+   threads/sched-prio.c. */
+extern int64_t load_average;
 
 /* If false (default), memory not intialized.
    If true, memory intialized.
@@ -185,6 +206,7 @@ void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
+struct thread *thread_find (tid_t);
 const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
@@ -198,7 +220,9 @@ void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-list_less_func priority_less;
-list_less_func lock_less;
-list_less_func cond_less;
+void thread_set_sched_class (const struct sched_class *);
+size_t thread_ready_cnt (void);
+
+void thread_donate_priority (struct thread *);
+void thread_update_priority (struct thread *);
 #endif /* threads/thread.h */
@@ -0,0 +1,123 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Scheduler event tracer.
+
+   Events are stored in a fixed-size ring buffer, overwriting
+   the oldest once it fills up.  Recording an event takes only a
+   few instructions with interrupts off, so hooks may sit in the
+   scheduler and in interrupt handlers.  trace_dump() prints the
+   buffer in a line-oriented text format that utils/trace2json
+   converts into Chrome trace JSON for viewing as a timeline:
+
+        trace begin
+        E <ns> <type> <tid> <other tid> <priority>
+        ...
+        N <tid> <name>
+        ...
+        trace end
+
+   "E" lines are events, oldest first.  An absent thread is
+   given as tid 0.  "N" lines name the threads alive at dump
+   time. */
+
+/* Number of records in the ring buffer.  Must be a power of 2. */
+#define TRACE_CNT 2048
+
+/* One recorded event. */
+struct trace_record
+  {
+    uint64_t cycles;            /* timer_cycles() at the event. */
+    tid_t tid;                  /* Thread the event is about. */
+    tid_t other;                /* Other thread involved, or 0. */
+    uint8_t type;               /* An enum trace_type. */
+    uint8_t priority;           /* Priority involved. */
+  };
+
+/* See trace.h. */
+bool trace_enabled;
+
+static struct trace_record records[TRACE_CNT];
+static unsigned head;           /* # of records ever written. */
+
+static const char *type_names[] =
+  {"switch", "wakeup", "block", "donate", "mlfqs", "preempt"};
+
+/* Clears the buffer and starts recording events. */
+void
+trace_start (void)
+{
+  enum intr_level old_level = intr_disable ();
+  head = 0;
+  trace_enabled = true;
+  intr_set_level (old_level);
+}
+
+/* Stops recording events.  The buffer is kept for trace_dump(). */
+void
+trace_stop (void)
+{
+  trace_enabled = false;
+}
+
+/* Records an event of the given TYPE about thread T.  OTHER, if
+   nonnull, is the other thread involved, and PRIORITY is the
+   priority involved.  Use the TRACE macro instead of calling
+   this directly. */
+void
+trace_event (enum trace_type type, const struct thread *t,
+             const struct thread *other, int priority)
+{
+  enum intr_level old_level = intr_disable ();
+  struct trace_record *r = &records[head++ % TRACE_CNT];
+
+  r->cycles = timer_cycles ();
+  r->tid = t != NULL ? t->tid : 0;
+  r->other = other != NULL ? other->tid : 0;
+  r->type = type;
+  r->priority = priority;
+  intr_set_level (old_level);
+}
+
+/* Prints the contents of the buffer, oldest event first, in the
+   format described at the top of this file.  Tracing is stopped
+   while the dump is in progress, so that printing does not
+   overwrite what is being printed. */
+void
+trace_dump (void)
+{
+  bool was_enabled = trace_enabled;
+  enum intr_level old_level;
+  unsigned first, i;
+  struct list_elem *e;
+
+  trace_stop ();
+  first = head > TRACE_CNT ? head - TRACE_CNT : 0;
+
+  printf ("trace begin\n");
+  for (i = first; i != head; i++)
+    {
+      const struct trace_record *r = &records[i % TRACE_CNT];
+      printf ("E %"PRIu64" %s %d %d %d\n", timer_cycles_to_ns (r->cycles),
+              type_names[r->type], r->tid, r->other, r->priority);
+    }
+  old_level = intr_disable ();
+  for (e = list_begin (&thread_list); e != list_end (&thread_list);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      printf ("N %d %s\n", t->tid, t->name);
+    }
+  intr_set_level (old_level);
+  printf ("trace end\n");
+  if (head > TRACE_CNT)
+    printf ("(%u older events were overwritten)\n", head - TRACE_CNT);
+
+  if (was_enabled)
+    trace_enabled = true;
+}
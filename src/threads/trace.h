@@ -0,0 +1,41 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Kinds of scheduler events. */
+enum trace_type
+  {
+    TRACE_SWITCH,       /* Context switch from THREAD to OTHER. */
+    TRACE_WAKEUP,       /* THREAD made ready, by OTHER. */
+    TRACE_BLOCK,        /* THREAD blocked. */
+    TRACE_DONATE,       /* OTHER donated PRIORITY to THREAD. */
+    TRACE_MLFQS,        /* MLFQS recomputed THREAD's PRIORITY. */
+    TRACE_PREEMPT       /* THREAD preempted in favor of OTHER. */
+  };
+
+/* True while events are being recorded.
+   Controlled by the "trace" shell command and the kernel
+   command-line option "-trace". */
+extern bool trace_enabled;
+
+/* Records an event if tracing is enabled.  When it is not, this
+   costs a single, well-predicted branch. */
+#define TRACE(TYPE, THREAD, OTHER, PRIORITY)                    \
+        do                                                      \
+          {                                                     \
+            if (__builtin_expect (trace_enabled, 0))            \
+              trace_event (TYPE, THREAD, OTHER, PRIORITY);      \
+          }                                                     \
+        while (0)
+
+void trace_start (void);
+void trace_stop (void);
+void trace_dump (void);
+void trace_event (enum trace_type, const struct thread *,
+                  const struct thread *other, int priority);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,195 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A workqueue and its worker thread. */
+struct workqueue
+  {
+    const char *name;           /* Worker thread name. */
+    int priority;               /* Worker thread priority. */
+    struct list works;          /* Pending work items. */
+    struct semaphore avail;     /* Counts pending work items. */
+    long long run_cnt;          /* # of work items run. */
+  };
+
+static struct workqueue workqueues[WQ_CNT] =
+  {
+    [WQ_HIGH] = {"kworker/high", PRI_MAX},
+    [WQ_NORMAL] = {"kworker", PRI_DEFAULT},
+  };
+
+/* Work items for the softirq pass.  Access with interrupts
+   off. */
+static struct list softirq_works;
+
+/* Statistics. */
+static long long softirq_pass_cnt;  /* # of softirq passes. */
+static long long softirq_run_cnt;   /* # of work items they ran. */
+
+static thread_func worker;
+static struct work *pop_work (struct list *);
+
+/* Initializes work item W to run FUNC, passing AUX. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->pending = false;
+}
+
+/* Initializes the softirq pass.  Must be called before
+   interrupts are enabled. */
+void
+softirq_init (void)
+{
+  list_init (&softirq_works);
+}
+
+/* Starts a worker thread for each workqueue.  Must be called
+   after thread_start(), before anything is queued. */
+void
+workqueue_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < WQ_CNT; i++)
+    {
+      struct workqueue *wq = &workqueues[i];
+
+      list_init (&wq->works);
+      sema_init (&wq->avail, 0);
+      if (thread_create (wq->name, wq->priority, worker, wq) == TID_ERROR)
+        PANIC ("could not start worker thread %s", wq->name);
+    }
+}
+
+/* Queues W to run in the worker thread of workqueue ID.  Returns
+   true if W was queued, false if it was already pending.  May be
+   called from an interrupt handler. */
+bool
+workqueue_push (enum workqueue_id id, struct work *w)
+{
+  struct workqueue *wq = &workqueues[id];
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (id < WQ_CNT);
+
+  old_level = intr_disable ();
+  if (!w->pending)
+    {
+      w->pending = true;
+      list_push_back (&wq->works, &w->elem);
+      sema_up (&wq->avail);
+      queued = true;
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Queues W to run in the softirq pass at the end of the current
+   external interrupt.  Returns true if W was queued, false if it
+   was already pending.  Must be called from an external
+   interrupt handler or from work in the softirq pass. */
+bool
+softirq_raise (struct work *w)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (intr_context ());
+
+  old_level = intr_disable ();
+  if (!w->pending)
+    {
+      w->pending = true;
+      list_push_back (&softirq_works, &w->elem);
+      queued = true;
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Runs the work items queued by softirq_raise(), including any
+   queued while it runs.  Called by the interrupt handler at the
+   end of each external interrupt, with interrupts off, after
+   acknowledging it and before yielding on return.  Each work
+   item runs with interrupts on. */
+void
+softirq_run (void)
+{
+  ASSERT (intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (list_empty (&softirq_works))
+    return;
+
+  softirq_pass_cnt++;
+  while (!list_empty (&softirq_works))
+    {
+      struct work *w = pop_work (&softirq_works);
+      softirq_run_cnt++;
+      intr_enable ();
+      w->func (w->aux);
+      intr_disable ();
+    }
+}
+
+/* Prints workqueue statistics. */
+void
+workqueue_print_stats (void)
+{
+  size_t i;
+
+  printf ("Softirq: %lld passes ran %lld work items\n",
+          softirq_pass_cnt, softirq_run_cnt);
+  for (i = 0; i < WQ_CNT; i++)
+    printf ("Workqueue: %s ran %lld work items\n",
+            workqueues[i].name, workqueues[i].run_cnt);
+}
+
+/* Worker thread for workqueue WQ_. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  /* We were created in our creator's class, where our priority
+     may mean nothing. */
+  thread_set_sched_class (&sched_prio);
+  thread_set_priority (wq->priority);
+
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w;
+
+      sema_down (&wq->avail);
+      old_level = intr_disable ();
+      w = pop_work (&wq->works);
+      wq->run_cnt++;
+      intr_set_level (old_level);
+
+      w->func (w->aux);
+    }
+}
+
+/* Removes and returns the first work item in LIST, marking it no
+   longer pending, so that it may queue itself again.
+   Interrupts must be off. */
+static struct work *
+pop_work (struct list *list)
+{
+  struct work *w = list_entry (list_pop_front (list), struct work, elem);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  w->pending = false;
+  return w;
+}
@@ -0,0 +1,63 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Deferred work.
+
+   An interrupt handler should only acknowledge its device and
+   hand the rest of its processing to one of two places:
+
+   - The softirq pass, for short work that must still happen
+     before the interrupted thread resumes, such as waking up
+     threads.  softirq_raise() queues a work item to run at the
+     end of the current external interrupt, after the interrupt
+     has been acknowledged at the interrupt controller.  Work in
+     the softirq pass runs with interrupts on, so it must turn
+     them off itself around data that interrupt handlers touch.
+     It still runs in interrupt context, so it may not sleep.
+
+   - A workqueue, for anything longer.  workqueue_push() queues
+     a work item to run in a kernel worker thread, where it may
+     sleep and interrupts are on.  There is one workqueue per
+     worker priority.  The workers always run in the priority
+     scheduling class, whatever the class of the thread that
+     started them, so they run ahead of every thread in a lower
+     class, such as under "-sched=fair" or "-mlfqs".
+
+   A work item is owned by its submitter and is queued at most
+   once at a time: queueing a work item that is still pending
+   does nothing. */
+
+/* Function run by a work item. */
+typedef void work_func (void *aux);
+
+/* A work item. */
+struct work
+  {
+    struct list_elem elem;      /* Element in a pending list. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Argument for FUNC. */
+    bool pending;               /* Queued and not yet started? */
+  };
+
+/* Workqueues, by the priority of their worker thread. */
+enum workqueue_id
+  {
+    WQ_HIGH,                    /* Worker at PRI_MAX. */
+    WQ_NORMAL,                  /* Worker at PRI_DEFAULT. */
+    WQ_CNT                      /* Number of workqueues. */
+  };
+
+void work_init (struct work *, work_func *, void *aux);
+
+void softirq_init (void);
+void workqueue_init (void);
+bool workqueue_push (enum workqueue_id, struct work *);
+void workqueue_print_stats (void);
+
+bool softirq_raise (struct work *);
+void softirq_run (void);
+
+#endif /* threads/workqueue.h */
@@ -180,20 +180,26 @@ page_fault (struct intr_frame *f)
      cur->user_stack_size = PHYS_BASE - upage;
    }
 
-  uint32_t *pte = lookup_page (cur->pagedir, fault_addr, false);
   struct frame_elem *frame_elem;
 
   lock_acquire (&pg_fault_lock);
 
-  get_frame (pte, &frame_elem, NULL);
+  get_frame (upage, &frame_elem, NULL);
 
   if (frame_elem != NULL)
    {
+     frame_wait_clean (frame_elem);
      frame_elem->flags |= FRAME_IO;
 
-     /* If the frame is not present in memory, then swap it in. */
-     if (frame_elem->flags & FRAME_SWAP)
-        swap_in (frame_elem);
+     /* If the frame is not present in memory, then swap it in.
+        Kill the process if there is no memory left for it. */
+     if ((frame_elem->flags & FRAME_SWAP) && !swap_in (frame_elem))
+      {
+        frame_elem->flags &= ~FRAME_IO;
+        lock_release (&pg_fault_lock);
+        cur->exit_status = -1;
+        thread_exit ();
+      }
 
      lock_release (&pg_fault_lock);
      schedule_without_rr ();
@@ -29,7 +29,7 @@ pagedir_create (void)
 
 extern struct bitmap *swap_freemap;
 extern struct lock pg_fault_lock;
-void pte_destroy (uint32_t *pte);
+void pte_destroy (uint32_t *pte, void *upage);
 
 /* Destroys page directory PD, freeing all the pages it
    references. */
@@ -50,43 +50,46 @@ pagedir_destroy (uint32_t *pd)
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          {
-            lock_acquire (&pg_fault_lock);
-            pte_destroy (pte); 
-            lock_release (&pg_fault_lock);
-          }
+          if (*pte != 0)
+            {
+              void *upage = (void *) ((uintptr_t) (pde - pd) << PDSHIFT
+                                      | (uintptr_t) (pte - pt) << PTSHIFT);
+              lock_acquire (&pg_fault_lock);
+              pte_destroy (pte, upage); 
+              lock_release (&pg_fault_lock);
+            }
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
 }
 
-/* Destroys page table entry PTE, freeing the page it
-   references. */
+/* Destroys page table entry PTE, which maps user page UPAGE,
+   freeing the page it references. */
 void
-pte_destroy (uint32_t *pte)
+pte_destroy (uint32_t *pte, void *upage UNUSED)
 {
+#ifdef VM
   struct frame_elem *f;
   struct pte_elem *pte_elem;
 
-#ifdef VM
-  frame_table_update ();
-
-  get_frame (pte, &f, &pte_elem);
+  get_frame (upage, &f, &pte_elem);
 
   if (f == NULL)
      return;
+  ASSERT (pte_elem->pte == pte);
+
+  frame_wait_clean (f);
+  frame_update (f);
 
-  /* Remove the page table entry from the frame element.*/ 
-  list_remove (&pte_elem->elem);
-  free (pte_elem);
+  /* Remove the page table entry from the frame element and from
+     the supplemental page table. */
+  frame_detach (pte_elem);
+  slab_free (&pte_cache, pte_elem);
 
   /* This frame is not shared by any other process. */
   if (list_empty (&f->pte_list))
    {
-     /* If the frame is swapped out, free the sectors allocated to it*/
-     if (f->flags & FRAME_SWAP)
-         bitmap_set_multiple (swap_freemap, f->sector_no, 8, false);
-     else
+     if (!(f->flags & FRAME_SWAP))
       {
         /* All dirty frames other than those of a memory mapped
            file should be discarded during eviction. */
@@ -95,12 +98,17 @@ pte_destroy (uint32_t *pte)
         evict (f);
       }
 
+     /* Free the swap sectors allocated to the frame, if any. */
+     if (f->flags & FRAME_SLOT)
+         bitmap_set_multiple (swap_freemap, f->sector_no, 8, false);
+
      /* If this frame is the hand (used in clock algorithm for eviction), 
         then the next node will be made as the hand node. */
      if (&(f->elem) == hand)
         hand = list_next (hand);
+     frame_index_remove (f);
      list_remove (&f->elem);
-     free (f);
+     slab_free (&frame_cache, f);
    }
 #else
    palloc_free_page (pte_get_page (*pte));
@@ -183,58 +191,55 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage,
   if (flags & FRAME_SWAP)
      *pte &= ~PTE_P;  
 
-  struct pte_elem *pte_elem = (struct pte_elem *)
-                              malloc (sizeof (struct pte_elem));
+  struct pte_elem *pte_elem = slab_alloc (&pte_cache);
   pte_elem->pte = pte;
+  pte_elem->upage = upage;
+
+  /* Only pages that stay identical to their file may be shared:
+     those of a memory mapped file and read-only executable pages. */
+  bool shareable = (flags & FRAME_MMAP)
+                   || ((flags & FRAME_EXEC) && !writable);
+
+  /* Check whether there is any such frame in the memory or in any of
+     the swap devices (swap disk and filesystem disk). */
+  struct frame_elem *f = NULL;
+  if (shareable)
+     f = frame_find (flags, sector_no, read_bytes);
+  if (f != NULL)
+   {
+     /* If the frame is already present in the memory, then update
+        the frame address in the page table entry of this page. */
+     if (!(f->flags & FRAME_SWAP))
+      {
+        *pte |= f->frame_addr;
+        *pte |= PTE_P;
+      }
 
-  struct list_elem *e;
+     frame_update (f);
 
-  for (e = list_begin (&frame_table); e != list_end (&frame_table); 
-       e = list_next (e))
-    {
-      struct frame_elem *f = list_entry (e, struct frame_elem, elem);
+     /* Status bits of this page should be in sync with its aliases. */
+     if (f->flags & FRAME_DIRTY)
+        *pte |= PTE_D;
+     if (f->flags & FRAME_ACCESSED)
+        *pte |= PTE_A;
 
-      /* Check whether there is any such frame in the memory or in any of
-         the swap devices (swap disk and filesystem disk). */
-       if ((f->flags & (flags & ~FRAME_SWAP)) && (f->sector_no == sector_no)
-           && (f->read_bytes >= read_bytes))
-        {
-          /* This page should not be shared. */
-          if ((flags & FRAME_EXEC) && writable)
-             break;
-
-          /* If the frame is already present in the memory, then update
-             the frame address in the page table entry of this page. */
-          if (!(f->flags & FRAME_SWAP))
-           {
-             *pte |= f->frame_addr;
-             *pte |= PTE_P;
-           }
-
-          frame_table_update ();
-
-          /* Status bits of this page should be in sync with its aliases. */
-          if (f->flags & FRAME_DIRTY)
-             *pte |= PTE_D;
-          if (f->flags & FRAME_ACCESSED)
-             *pte |= PTE_A;
-
-          list_push_back (&f->pte_list, &pte_elem->elem);
-          lock_release (&pg_fault_lock);
-          return true;
-       }
-    }
+     frame_attach (f, pte_elem);
+     lock_release (&pg_fault_lock);
+     return true;
+   }
 
   /* If the required frame is not present in the memory or in any of the
      swap devices, create a new frame. */
-  struct frame_elem *f = (struct frame_elem *) 
-                          malloc (sizeof (struct frame_elem));
+  f = slab_alloc (&frame_cache);
   f->frame_addr = *pte & ~PTE_FLAGS;
   f->sector_no = sector_no;
   f->flags = flags;
   f->read_bytes = read_bytes;
+  f->indexed = false;
   list_init (&f->pte_list);
-  list_push_back (&f->pte_list, &pte_elem->elem);
+  frame_attach (f, pte_elem);
+  if (shareable)
+     frame_index_insert (f);
   list_push_back (&frame_table, &f->elem);
   lock_release (&pg_fault_lock);
 
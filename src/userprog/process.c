@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -15,10 +16,13 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/frame.h"
 
+extern struct lock pg_fault_lock;
+
 static thread_func execute_thread NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
@@ -93,29 +97,25 @@ execute_thread (void *file_name_)
    been successfully called for the given TID, returns -1
    immediately, without waiting.
 
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   A child that has exited stays in the tid index until its
+   parent waits for it, blocked in process_exit(), so CHILD
+   cannot go away under us. */
 int
 process_wait (tid_t child_tid) 
 {
   struct thread *cur = thread_current ();
-  struct list_elem *e;
-  for (e = list_begin (&cur->children); e != list_end (&cur->children);
-       e = list_next (e))
-    {
-      struct child *child = list_entry (e, struct child, elem);
-      if (child->thread->tid == child_tid)
-       {
-         sema_down (&child->thread->wait);
-         int child_status = child->thread->exit_status;
-      //   printf ("%s: exit(%d)\n",child->thread->name, child_status);
-         sema_up (&child->thread->zombie);
-         list_remove (e);
-         free (child);
-         return child_status;
-       }
-    }
-  return -1;
+  struct thread *child = thread_find (child_tid);
+  int child_status;
+
+  if (child == NULL || child->parent != cur)
+    return -1;
+  list_remove (&child->child_elem);
+  child->parent = NULL;
+
+  sema_down (&child->wait);
+  child_status = child->exit_status;
+  sema_up (&child->zombie);
+  return child_status;
 }
 
 /* Free the current process's resources. */
@@ -136,7 +136,7 @@ process_exit (void)
       struct file_desc *file_d = list_entry (e, struct file_desc, elem);
       file_close (file_d->file);
       e = list_remove (e);
-      free (file_d);
+      slab_free (&file_desc_cache, file_d);
     }
     
   /* Destroy the current process's page directory and switch back
@@ -154,8 +154,17 @@ process_exit (void)
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
+#ifdef VM
+      page_table_destroy (&cur->pages);
+#endif
     }
 
+  /* Disown the children not waited for, so that a thread that
+     later reuses this thread's page cannot wait for them. */
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_remove (e))
+    list_entry (e, struct thread, child_elem)->parent = NULL;
+
   sema_init (&cur->zombie, 0);
   sema_up (&cur->wait);
   sema_down (&cur->zombie);
@@ -264,6 +273,14 @@ load (const char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  if (!page_table_init (&t->pages))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+#endif
   process_activate ();
 
   char *str;
@@ -564,16 +581,14 @@ setup_stack (void **esp)
   uint8_t *kpage;
   bool success = false;
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-
 #ifdef VM
   /* If there are no pages avaiable in the user pool, evict a frame and then
      allocate a page for the stack. */
-  if (kpage == NULL)
-   {
-     evict (clock ());
-     kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-   }
+  lock_acquire (&pg_fault_lock);
+  kpage = frame_get_page ();
+  lock_release (&pg_fault_lock);
+#else
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
 #endif
 
   if (kpage != NULL)
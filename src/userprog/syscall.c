@@ -18,9 +18,13 @@ static void exit_on_badarg (uint32_t*, int);
 
 extern struct lock pg_fault_lock;
 
+struct slab_cache file_desc_cache;
+
 void
 syscall_init (void) 
 {
+  slab_cache_init (&file_desc_cache, "file_desc", sizeof (struct file_desc),
+                   NULL);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -115,8 +119,7 @@ syscall_handler (struct intr_frame *f )
              f->eax = -1;
              return;
            }
-          struct file_desc *file_d = (struct file_desc *)
-                                     malloc (sizeof (struct file_desc));
+          struct file_desc *file_d = slab_alloc (&file_desc_cache);
 
           int fd;
           if (list_empty (fd_list))
@@ -156,7 +159,7 @@ syscall_handler (struct intr_frame *f )
                {
                  file_close (file_d->file);
                  list_remove (e);
-                 free (file_d);
+                 slab_free (&file_desc_cache, file_d);
                  break;
                }
             }
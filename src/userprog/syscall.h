@@ -10,9 +10,13 @@
 #include "filesys/filesys.h"
 #include "filesys/directory.h"
 #include "filesys/inode.h"
+#include "threads/slab.h"
 #include <list.h>
 #include <string.h>
 
+/* Cache of open file descriptors. */
+extern struct slab_cache file_desc_cache;
+
 void syscall_init (void);
 
 #endif /* userprog/syscall.h */
@@ -1,171 +1,589 @@
 #include "vm/frame.h"
+#include <stdio.h>
 #include "threads/thread.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/pte.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "vm/swap.h"
 #include <list.h>
 
-/* Initializes the frame table and hand node. */
+struct slab_cache frame_cache;
+struct slab_cache pte_cache;
+
+extern struct lock pg_fault_lock;
+
+/* kswapd evicts frames while fewer than KSWAPD_HIGH user pages
+   are free, once fewer than KSWAPD_LOW are. */
+#define KSWAPD_LOW 16
+#define KSWAPD_HIGH 32
+
+static struct semaphore kswapd_wake;    /* Upped to wake kswapd. */
+static bool kswapd_running;             /* Woken and not done yet? */
+static thread_func kswapd NO_RETURN;
+
+/* The page cleaner writes back dirty frames ahead of the clock
+   hand once fewer than CLEAN_LOW user pages are free, before
+   kswapd starts evicting, so that the frames that kswapd and
+   page faults evict are usually clean already.  It examines the
+   frame_clean_ahead frames from the hand on, and writes back
+   those that are dirty and not recently referenced, if more than
+   frame_dirty_ratio percent of the frames in memory among them
+   are dirty. */
+#define CLEAN_LOW (2 * KSWAPD_HIGH)
+int frame_dirty_ratio = 10;
+int frame_clean_ahead = 32;
+
+static struct semaphore clean_wake;     /* Upped to wake the cleaner. */
+static bool clean_running;              /* Woken and not done yet? */
+static struct frame_elem *clean_frame;  /* Frame being written, if any. */
+static struct condition clean_done;     /* Signaled when it is written. */
+static thread_func pgclean NO_RETURN;
+
+/* Eviction statistics. */
+static long long clock_scan_cnt;        /* Frames examined by clock(). */
+static long long direct_reclaim_cnt;    /* Evictions by faulting threads. */
+static long long kswapd_evict_cnt;      /* Evictions by kswapd. */
+static long long kswapd_wake_cnt;       /* Times kswapd woke up. */
+static long long clean_wake_cnt;        /* Times the cleaner woke up. */
+
+/* Share index.
+
+   Frames whose contents come straight from a file, and so may be
+   mapped by every process that maps the same part of that file,
+   are kept in a hash table keyed by the disk sector they are read
+   from and by whether they belong to an executable or to a
+   memory mapped file.  pagedir_set_page() looks a new page up
+   here instead of walking the frame table.  A sector identifies
+   both the inode and the offset within it, because the file
+   system allocates each file contiguously.
+
+   Only frames that stay identical to their backing are indexed:
+   read-only executable pages, which covers the text and the
+   read-only data, and memory mapped pages, which all processes
+   see the same way because they are written back to the file.
+   Writable executable pages and zero pages are private. */
+static struct hash frame_index;
+
+/* Sharing statistics. */
+static size_t share_pages;      /* PTEs mapping a frame that another
+                                   PTE also maps. */
+static size_t share_peak;       /* Most share_pages ever. */
+static long long share_cnt;     /* Pages mapped to an existing frame. */
+static long long index_miss_cnt; /* Shareable pages loaded anew. */
+
+/* Returns the share index key of frame F. */
+static unsigned
+index_key (const struct frame_elem *f)
+{
+  return f->sector_no * 2 + ((f->flags & FRAME_MMAP) != 0);
+}
+
+/* Returns a hash value for the frame_elem that contains E. */
+static unsigned
+index_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (index_key (hash_entry (e, struct frame_elem,
+                                          index_elem)));
+}
+
+/* Returns true if the frame_elem that contains A has a lower
+   share index key than the one that contains B. */
+static bool
+index_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (index_key (hash_entry (a, struct frame_elem, index_elem))
+          < index_key (hash_entry (b, struct frame_elem, index_elem)));
+}
+
+/* Initializes the frame table, its caches, share index and hand
+   node. */
 void
 frame_init ()
 {
   list_init (&frame_table);
+  if (!hash_init (&frame_index, index_hash, index_less, NULL))
+    PANIC ("could not allocate share index");
+  slab_cache_init (&frame_cache, "frame_elem", sizeof (struct frame_elem),
+                   NULL);
+  slab_cache_init (&pte_cache, "pte_elem", sizeof (struct pte_elem), NULL);
   hand = NULL;
+
+  sema_init (&kswapd_wake, 0);
+  kswapd_running = false;
+  if (thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL) == TID_ERROR)
+    PANIC ("could not start kswapd");
+
+  sema_init (&clean_wake, 0);
+  clean_running = false;
+  cond_init (&clean_done);
+  if (thread_create ("pgclean", PRI_DEFAULT, pgclean, NULL) == TID_ERROR)
+    PANIC ("could not start the page cleaner");
 }
 
-/* Obtains the frame details of the frame corresponding to the 
-   page table entry PTE. */
+/* Returns the indexed frame that holds the page read from
+   SECTOR_NO with the given FLAGS, if it holds at least READ_BYTES
+   bytes of it, or a null pointer otherwise. */
+struct frame_elem *
+frame_find (int flags, disk_sector_t sector_no, size_t read_bytes)
+{
+  struct frame_elem key;
+  struct hash_elem *e;
+  struct frame_elem *f;
+
+  key.sector_no = sector_no;
+  key.flags = flags & FRAME_MMAP;
+  e = hash_find (&frame_index, &key.index_elem);
+  if (e == NULL)
+    {
+      index_miss_cnt++;
+      return NULL;
+    }
+  f = hash_entry (e, struct frame_elem, index_elem);
+  if (f->read_bytes < read_bytes)
+    {
+      index_miss_cnt++;
+      return NULL;
+    }
+  share_cnt++;
+  return f;
+}
+
+/* Adds F to the share index, unless another frame already holds
+   its key. */
 void
-get_frame (uint32_t *pte, struct frame_elem **f, struct pte_elem **p)
+frame_index_insert (struct frame_elem *f)
 {
-  struct list_elem *e; 
+  f->indexed = hash_insert (&frame_index, &f->index_elem) == NULL;
+}
 
-  for (e = list_begin (&frame_table); e != list_end (&frame_table);
-       e = list_next (e))
+/* Removes F from the share index, if it is there.  Called when F
+   stops matching its backing or is freed. */
+void
+frame_index_remove (struct frame_elem *f)
+{
+  if (f->indexed)
     {
-      struct frame_elem *fe = list_entry (e, struct frame_elem, elem);
-      struct list *pte_list = &(fe->pte_list);
-      struct list_elem *e_;
-      for (e_ = list_begin (pte_list); e_ != list_end (pte_list);
-           e_ = list_next (e_))
-        {
-          struct pte_elem *pe = list_entry (e_, struct pte_elem, elem);
-          if (pte == pe->pte)
-           {
-             if (f != NULL) *f = fe; 
-             if (p != NULL) *p = pe;
-             return;
-           }
-        }
+      hash_delete (&frame_index, &f->index_elem);
+      f->indexed = false;
     }
+}
 
-  if (f != NULL) *f = NULL; 
-  if (p != NULL) *p = NULL;
+/* Makes P, whose pte and upage members are set, map frame F, and
+   adds it to the running process's supplemental page table. */
+void
+frame_attach (struct frame_elem *f, struct pte_elem *p)
+{
+  if (!list_empty (&f->pte_list) && ++share_pages > share_peak)
+    share_peak = share_pages;
+  p->frame = f;
+  list_push_back (&f->pte_list, &p->elem);
+  page_table_insert (p);
+}
+
+/* Undoes frame_attach() for P.  Does not free P or its frame. */
+void
+frame_detach (struct pte_elem *p)
+{
+  list_remove (&p->elem);
+  page_table_remove (p);
+  if (!list_empty (&p->frame->pte_list))
+    share_pages--;
+}
+
+/* Prints frame sharing statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %zu in share index, %lld pages shared, "
+          "%lld loaded anew\n",
+          hash_size (&frame_index), share_cnt, index_miss_cnt);
+  printf ("Frames: %zu kB saved by sharing, %zu kB at peak\n",
+          share_pages * PGSIZE / 1024, share_peak * PGSIZE / 1024);
+  printf ("Frames: %lld examined by clock, %lld evicted by faults, "
+          "%lld by kswapd in %lld wakeups\n",
+          clock_scan_cnt, direct_reclaim_cnt, kswapd_evict_cnt,
+          kswapd_wake_cnt);
+  printf ("Frames: page cleaner woke up %lld times\n", clean_wake_cnt);
+}
+
+/* Supplemental page table.
+
+   Each process keeps its pte_elems in a hash table, keyed by the
+   user page that each one maps, so that finding the frame behind
+   a user page takes constant time instead of a walk over every
+   PTE of every frame.  The functions below work on the running
+   process's table, since the page fault handler, mmap and
+   process teardown all run in the context of the process whose
+   pages they handle. */
+
+/* Returns a hash value for the pte_elem that contains E. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct pte_elem *p = hash_entry (e, struct pte_elem, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if the pte_elem that contains A maps a lower
+   user page than the one that contains B. */
+static bool
+page_less (const struct hash_elem *a, const struct hash_elem *b,
+           void *aux UNUSED)
+{
+  return (hash_entry (a, struct pte_elem, hash_elem)->upage
+          < hash_entry (b, struct pte_elem, hash_elem)->upage);
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns false if memory allocation fails. */
+bool
+page_table_init (struct hash *pages)
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Adds P, whose upage member is set, to the running process's
+   supplemental page table. */
+void
+page_table_insert (struct pte_elem *p)
+{
+  struct hash_elem *old = hash_insert (&thread_current ()->pages,
+                                       &p->hash_elem);
+  ASSERT (old == NULL);
+}
+
+/* Removes P from the running process's supplemental page
+   table. */
+void
+page_table_remove (struct pte_elem *p)
+{
+  hash_delete (&thread_current ()->pages, &p->hash_elem);
+}
+
+/* Frees the memory used by PAGES, from which every pte_elem
+   must have been removed. */
+void
+page_table_destroy (struct hash *pages)
+{
+  ASSERT (hash_empty (pages));
+  hash_destroy (pages, NULL);
+}
+
+/* Obtains the frame of the running process that is mapped at
+   user page UPAGE, and the pte_elem that maps it. */
+void
+get_frame (const void *upage, struct frame_elem **f, struct pte_elem **p)
+{
+  struct pte_elem key;
+  struct hash_elem *e;
+  struct pte_elem *pe = NULL;
+
+  key.upage = pg_round_down (upage);
+  e = hash_find (&thread_current ()->pages, &key.hash_elem);
+  if (e != NULL)
+    pe = hash_entry (e, struct pte_elem, hash_elem);
+
+  if (f != NULL) *f = pe != NULL ? pe->frame : NULL;
+  if (p != NULL) *p = pe;
 }
 
 /* Evicts a VICTIM frame. */
 void
 evict (struct frame_elem *victim)
 {
-  if (victim->flags & FRAME_DIRTY)
-   {
-     /* The page is no longer an all zero page, 
-        if it has become dirty. */ 
-     if (victim->read_bytes == 0)
-      {
-        int i;
-        uint8_t *page = ptov (victim->frame_addr);
-        for (i = PGSIZE-1; i >= 0; i--)
-            if (page[i] != 0)
-               break;
-        victim->read_bytes = i+1;
-      }
-
-     /* The page can no longer be read from an executable, 
-        if it has become dirty. */ 
-     victim->flags &= ~FRAME_EXEC;
-   }
-
   swap_out (victim);
+}
+
+/* Update the status bits (accessed and dirty) of frame F. */
+void
+frame_update (struct frame_elem *f)
+{
+  struct list_elem *e;
+
+  f->flags &= ~(FRAME_DIRTY | FRAME_ACCESSED);
+  for (e = list_begin (&f->pte_list);
+       (e != list_end (&f->pte_list)) &&
+        !(f->flags & (FRAME_DIRTY | FRAME_ACCESSED));
+       e = list_next (e))
+    {
+      uint32_t *pte = list_entry (e, struct pte_elem, elem)->pte;
 
+      /* Set the dirty bit if the frame is found dirty. */
+      if (*pte & PTE_D)
+         f->flags |= FRAME_DIRTY;
+
+      /* Set the accessed bit if the frame was recently referenced. */
+      if (*pte & PTE_A)
+         f->flags |= FRAME_ACCESSED;
+    }
 }
 
-/* Update the status bits (accessed and dirty) of each frame. */
-void 
-frame_table_update ()
+/* Returns the accessed and dirty bits that are set in any of
+   F's PTEs. */
+static uint32_t
+alias_bits (struct frame_elem *f)
 {
   struct list_elem *e;
-  for (e = list_begin (&frame_table); e != list_end (&frame_table); 
+  uint32_t bits = 0;
+
+  for (e = list_begin (&f->pte_list); e != list_end (&f->pte_list);
+       e = list_next (e))
+    bits |= *list_entry (e, struct pte_elem, elem)->pte & (PTE_A | PTE_D);
+  return bits;
+}
+
+/* Gathers the status bits of F's PTEs into F's flags, as
+   frame_update() does, then gives every PTE of F the dirty bit if
+   any of them has it, so that the aliases agree, and clears their
+   accessed bits.  Returns true if F was referenced since the last
+   call.  Takes time linear in the number of F's aliases only. */
+static bool
+frame_harvest (struct frame_elem *f)
+{
+  struct list_elem *e;
+  uint32_t bits = alias_bits (f);
+  bool accessed = (bits & PTE_A) != 0;
+  bool dirty = (bits & PTE_D) != 0;
+
+  for (e = list_begin (&f->pte_list); e != list_end (&f->pte_list);
        e = list_next (e))
     {
-      struct frame_elem *f = list_entry (e, struct frame_elem, elem);
-      f->flags &= ~(FRAME_DIRTY | FRAME_ACCESSED);
-
-      struct list_elem *e_;
-      for (e_ = list_begin (&f->pte_list); 
-           (e_ != list_end (&f->pte_list)) && 
-            !(f->flags & (FRAME_DIRTY | FRAME_ACCESSED));
-           e_ = list_next (e_))
-        {
-          uint32_t *pte = list_entry (e_, struct pte_elem, elem)->pte;
-
-          /* Set the dirty bit if the frame is found dirty. */
-          if (*pte & PTE_D)
-             f->flags |= FRAME_DIRTY;
-
-          /* Set the accessed bit if the frame was recently referenced. */
-          if (*pte & PTE_A)
-             f->flags |= FRAME_ACCESSED;
-        }
+      uint32_t *pte = list_entry (e, struct pte_elem, elem)->pte;
+      *pte &= ~PTE_A;
+      if (dirty)
+         *pte |= PTE_D;
     }
+
+  f->flags &= ~(FRAME_DIRTY | FRAME_ACCESSED);
+  if (dirty)
+     f->flags |= FRAME_DIRTY;
+  return accessed;
 }
 
-/* Selects a frame for eviction from frame table using clock algorithm. */   
+/* Selects a frame for eviction from frame table using clock
+   algorithm.  Only the frames that the hand passes over are
+   examined: a frame referenced since the hand last passed it
+   loses its accessed bits and is skipped, and the first frame
+   that was not referenced is the victim.  Returns a null pointer
+   if the hand goes around the table twice without finding a
+   victim, which happens only if every frame is swapped out or
+   being swapped in. */
 struct frame_elem * 
 clock ()
 {
-  /* Update the status bits of all the frames in the frame table. */
-  frame_table_update ();
+  struct list_elem *e;
+  int laps = 0;
 
   /* Initialize the hand node, if it is not. */
   if (hand == NULL) 
      hand = list_begin (&frame_table);
 
-  struct list_elem *e;
   for (e = hand; ; e = list_next (e))
     {
       /* Wrap around if you reach the end of the list. */
       if (e == list_end (&frame_table)) 
+       {
+         if (++laps > 2 || list_empty (&frame_table))
+          {
+            hand = NULL;
+            return NULL;
+          }
          e = list_begin (&frame_table);
+       }
 
       struct frame_elem *f = list_entry (e, struct frame_elem, elem);
+      clock_scan_cnt++;
 
       /* A swapped out frame or a frame being swapped in, 
          does not participate in eviction. */
       if ((f->flags & FRAME_SWAP) || (f->flags & FRAME_IO))
          continue;
 
-      /* Mark the frame as not referenced, if it was recently referenced. */
-      if (f->flags & FRAME_ACCESSED)
-         f->flags &= ~FRAME_ACCESSED;
-      else
+      /* Give the frame a second chance, if it was recently
+         referenced. */
+      if (!frame_harvest (f))
        {
          /* Call the next node as the hand node. */
          hand = list_next (e);
 
-         /* Aliases of each frame must be updated to have the same
-            value in their status bits. */
-         sync_aliases ();
-
          /* Return the current node's frame as the victim frame. */
          return f;
        }
     }
 }
 
-/* Aliases of each frame must be updated to have the same value in their 
-   status bits. */
+/* Evicts one frame chosen by clock(), if there is one. */
+static void
+reclaim (void)
+{
+  struct frame_elem *victim = clock ();
+  if (victim != NULL)
+     evict (victim);
+}
+
+/* Returns a zeroed page from the user pool for a user frame,
+   evicting a frame first if the pool is empty, or a null pointer
+   if no frame could be evicted.  Wakes kswapd if the pool runs
+   low.  Must be called with pg_fault_lock held. */
+void *
+frame_get_page (void)
+{
+  void *page = palloc_get_page (PAL_USER | PAL_ZERO);
+  size_t free_cnt;
+
+  if (page == NULL)
+   {
+     direct_reclaim_cnt++;
+     reclaim ();
+     page = palloc_get_page (PAL_USER | PAL_ZERO);
+   }
+
+  free_cnt = palloc_user_free_cnt ();
+  if (!clean_running && free_cnt < CLEAN_LOW)
+   {
+     clean_running = true;
+     sema_up (&clean_wake);
+   }
+  if (!kswapd_running && free_cnt < KSWAPD_LOW)
+   {
+     kswapd_running = true;
+     sema_up (&kswapd_wake);
+   }
+  return page;
+}
+
+/* Evicts frames in the background, whenever fewer than
+   KSWAPD_LOW user pages are free, until KSWAPD_HIGH are, so that
+   page faults seldom have to evict a frame themselves. */
+static void
+kswapd (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&kswapd_wake);
+      kswapd_wake_cnt++;
+      for (;;)
+       {
+         struct frame_elem *victim;
+
+         lock_acquire (&pg_fault_lock);
+         victim = palloc_user_free_cnt () < KSWAPD_HIGH ? clock () : NULL;
+         if (victim != NULL)
+          {
+            evict (victim);
+            kswapd_evict_cnt++;
+          }
+         lock_release (&pg_fault_lock);
+         if (victim == NULL)
+            break;
+       }
+      kswapd_running = false;
+    }
+}
+
+/* Examines up to frame_clean_ahead frames from the clock hand on.
+   Returns the first one that is in memory, dirty and not
+   recently referenced, or a null pointer if there is none.
+   Stores the number of frames in memory that it examined in
+   *CNT, and how many of them are dirty in *DIRTY_CNT.  Must be
+   called with pg_fault_lock held. */
+static struct frame_elem *
+dirty_ahead (int *dirty_cnt, int *cnt)
+{
+  struct frame_elem *found = NULL;
+  struct list_elem *start, *e;
+  int i;
+
+  *dirty_cnt = *cnt = 0;
+  if (list_empty (&frame_table))
+     return NULL;
+
+  start = hand;
+  if (start == NULL || start == list_end (&frame_table))
+     start = list_begin (&frame_table);
+
+  e = start;
+  for (i = 0; i < frame_clean_ahead; i++)
+    {
+      struct frame_elem *f = list_entry (e, struct frame_elem, elem);
+
+      if (!(f->flags & (FRAME_SWAP | FRAME_IO)))
+       {
+         uint32_t bits = alias_bits (f);
+
+         (*cnt)++;
+         if (bits & PTE_D)
+          {
+            (*dirty_cnt)++;
+            if (found == NULL && !(bits & PTE_A))
+               found = f;
+          }
+       }
+
+      e = list_next (e);
+      if (e == list_end (&frame_table))
+         e = list_begin (&frame_table);
+      if (e == start)
+         break;
+    }
+  return found;
+}
+
+/* Waits until the page cleaner is done writing F, if it is
+   writing it.  Must be called with pg_fault_lock held. */
 void
-sync_aliases ()
+frame_wait_clean (struct frame_elem *f)
 {
-  struct list_elem *e;
-  for (e = list_begin (&frame_table); e != list_end (&frame_table); 
-       e = list_next (e))
-     {
-       struct frame_elem *f = list_entry (e, struct frame_elem, elem);
-
-       struct list_elem *e_;
-       for (e_ = list_begin (&f->pte_list); e_ != list_end (&f->pte_list);
-            e_ = list_next (e_))
-         {
-           uint32_t *pte = list_entry (e_, struct pte_elem, elem)->pte;
-
-           /* Set the dirty bit if the frame is found dirty. */
-           (f->flags & FRAME_DIRTY) ?  (*pte |= PTE_D) : (*pte &= ~PTE_D);
-
-           /* Set the accessed bit if the frame was recently referenced. */
-           (f->flags & FRAME_ACCESSED) ?  (*pte |= PTE_A) : (*pte &= ~PTE_A);
-         }
-     }
+  while (f == clean_frame)
+    cond_wait (&clean_done, &pg_fault_lock);
+}
+
+/* Writes back dirty frames ahead of the clock hand whenever
+   frame_get_page() finds the user pool running low, at most
+   frame_clean_ahead of them each time it is woken up. */
+static void
+pgclean (void *aux UNUSED)
+{
+  for (;;)
+    {
+      int written = 0;
+
+      sema_down (&clean_wake);
+      clean_wake_cnt++;
+      while (written < frame_clean_ahead)
+       {
+         struct frame_elem *f;
+         int dirty_cnt, cnt;
+
+         lock_acquire (&pg_fault_lock);
+         f = dirty_ahead (&dirty_cnt, &cnt);
+         if (f != NULL
+             && (written > 0 || dirty_cnt * 100 > frame_dirty_ratio * cnt))
+          {
+            /* swap_write() drops pg_fault_lock during the write.
+               FRAME_IO keeps clock() from evicting the frame
+               meanwhile, and frame_wait_clean() keeps anyone
+               from freeing it or faulting it in. */
+            f->flags |= FRAME_IO;
+            clean_frame = f;
+            if (swap_write (f, true))
+               written++;
+            else
+               f = NULL;
+            clean_frame->flags &= ~FRAME_IO;
+            frame_update (clean_frame);
+            clean_frame = NULL;
+            cond_broadcast (&clean_done, &pg_fault_lock);
+          }
+         else
+            f = NULL;
+         lock_release (&pg_fault_lock);
+         if (f == NULL)
+            break;
+       }
+      clean_running = false;
+    }
 }
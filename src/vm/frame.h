@@ -1,5 +1,10 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <hash.h>
 #include <list.h>
 #include "devices/disk.h"
+#include "threads/slab.h"
 
 /* Type of the frame.  */
 enum frame_flags
@@ -9,8 +14,10 @@ enum frame_flags
     FRAME_SWAP       = 004,         /* A swapped out frame. */
     FRAME_DIRTY      = 010,	    /* A dirty frame (modified). */
     FRAME_ACCESSED   = 020,         /* A recently referenced frame. */
-    FRAME_IO         = 040          /* Frame being read/written from/into 
+    FRAME_IO         = 040,         /* Frame being read/written from/into 
                                        the disk. */
+    FRAME_SLOT       = 0100         /* Frame has a slot on the swap disk,
+                                       at sector_no. */
   };
 
 /* An entry in the frame table. */
@@ -26,24 +33,51 @@ struct frame_elem
                                       memory mapped file. 
                                       Number of non-zero bytes in the frame,
                                       otherwise. */
+    struct hash_elem index_elem;   /* Element in the share index. */
+    bool indexed;                  /* In the share index? */
   };
 
 /* List of all frames. */
 struct list frame_table;
 
-/* An entry in the pte_list of a frame table element. */
+/* An entry in the pte_list of a frame table element, and in its
+   process's supplemental page table. */
 struct pte_elem
   {
     uint32_t *pte;                 /* Pointer to Page Table Entry. */
+    void *upage;                   /* User virtual page that PTE maps. */
+    struct frame_elem *frame;      /* Frame that PTE maps. */
     struct list_elem elem;         /* This element. */
+    struct hash_elem hash_elem;    /* Element in supplemental page table. */
   };
 
+/* Caches of frame table elements and of pte_list elements. */
+extern struct slab_cache frame_cache;
+extern struct slab_cache pte_cache;
+
 /* Hand element in the clock algorithm. */
 struct list_elem *hand;
 
+/* Page cleaner tunables. */
+extern int frame_dirty_ratio;
+extern int frame_clean_ahead;
+
 void frame_init (void);
-void frame_table_update (void);
-void sync_aliases (void);
+struct frame_elem *frame_find (int, disk_sector_t, size_t);
+void frame_index_insert (struct frame_elem *);
+void frame_index_remove (struct frame_elem *);
+void frame_attach (struct frame_elem *, struct pte_elem *);
+void frame_detach (struct pte_elem *);
+void frame_print_stats (void);
+bool page_table_init (struct hash *);
+void page_table_insert (struct pte_elem *);
+void page_table_remove (struct pte_elem *);
+void page_table_destroy (struct hash *);
+void frame_update (struct frame_elem *);
+void frame_wait_clean (struct frame_elem *);
 struct frame_elem *clock (void);
+void *frame_get_page (void);
 void evict (struct frame_elem *);
-void get_frame (uint32_t *, struct frame_elem **, struct pte_elem **); 
+void get_frame (const void *, struct frame_elem **, struct pte_elem **);
+
+#endif /* vm/frame.h */
@@ -5,10 +5,13 @@
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "userprog/pagedir.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 
+extern struct lock pg_fault_lock;
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -77,39 +80,42 @@ mmap (int fd, void *addr)
 void
 munmap (mapid_t mapping)
 {
-  struct thread *cur = thread_current ();
-  uint32_t *pd = cur->pagedir;
   uint8_t *page;
   int flength = PGSIZE;
 
   for (page = mapping; page < (uint8_t *)mapping + flength; page += PGSIZE)
     { 
-      uint32_t *pte = lookup_page (pd, page, false);
-
-      struct list_elem *e;
       struct frame_elem *f;
       struct pte_elem *pte_elem;
+      disk_sector_t sector_no;
 
-      get_frame (pte, &f, &pte_elem);
-
-      struct inode *inode = inode_open (f->sector_no);
+      /* Keep kswapd and the page cleaner off the frame while we
+         write it back and detach from it, as pagedir_destroy()
+         does. */
+      lock_acquire (&pg_fault_lock);
+      get_frame (page, &f, &pte_elem);
+      frame_wait_clean (f);
+      sector_no = f->sector_no;
 
-      /* Close the inode twice. Once for the above open and once for the open
-         in mmap. */
-      inode_close (inode); 
-      inode_close (inode); 
-      
       if (page == mapping)
          flength = f->read_bytes;
 
       if (!(f->flags & FRAME_SWAP))
        {
-         frame_table_update ();
+         frame_update (f);
          evict (f);
        }
  
-      list_remove (&pte_elem->elem);
-      free (pte_elem);
+      frame_detach (pte_elem);
+      slab_free (&pte_cache, pte_elem);
+      lock_release (&pg_fault_lock);
+
+      struct inode *inode = inode_open (sector_no);
+
+      /* Close the inode twice. Once for the above open and once for the open
+         in mmap. */
+      inode_close (inode); 
+      inode_close (inode); 
       return;
     }
 }
@@ -3,6 +3,7 @@
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "filesys/filesys.h"
@@ -17,6 +18,12 @@ struct disk *swap_disk;
 /* Bitmap indicating free sectors on the swap disk. */
 struct bitmap *swap_freemap = NULL;
 
+extern struct lock pg_fault_lock;
+
+/* Writeback statistics. */
+static long long sync_write_cnt;        /* Pages written at eviction. */
+static long long background_write_cnt;  /* Pages written by the cleaner. */
+
 /* Initializes the swap disk and creates a freemap of sectors 
    on the swap disk. */
 void 
@@ -36,10 +43,11 @@ swap_init()
       bitmap_mark (swap_freemap, i);
 }
 
+/* Evicts FRAME_ELEM, which is in memory, writing it back first
+   if it is dirty. */
 void
 swap_out (struct frame_elem *frame_elem)
 {
-  size_t sector_no = frame_elem->sector_no;
   void *page = ptov (frame_elem->frame_addr);
 
   frame_elem->flags |= FRAME_SWAP;
@@ -62,58 +70,115 @@ swap_out (struct frame_elem *frame_elem)
 
   intr_set_level (level);
 
+  if ((frame_elem->flags & FRAME_DIRTY) && !swap_write (frame_elem, false))
+   {
+     printf ("Out of virtual memory!!!!\n");
+     return;
+   }
+
+  /* Now, free the memory utilized by the page. */
+  palloc_free_page (page);
+
+}
+
+/* Writes FRAME_ELEM, which is in memory and dirty, back to its
+   memory mapped file, or else to its slot on the swap disk,
+   allocating the slot first if it has none.  The frame and its
+   PTEs are clean afterward, unless the page is modified again
+   while it is being written.  BACKGROUND tells whether the page
+   cleaner, rather than eviction, is writing it; if so, the
+   caller must have marked the frame FRAME_IO, and
+   pg_fault_lock is released while the page is on its way to
+   disk.  Returns false if the swap disk is full. */
+bool
+swap_write (struct frame_elem *frame_elem, bool background)
+{
+  uint8_t *page = ptov (frame_elem->frame_addr);
+  size_t sector_no;
   struct disk *disk;
-  
-  if (!(frame_elem->flags & FRAME_DIRTY))
-       goto done;
- 
-  else if (frame_elem->flags & FRAME_MMAP)
-       disk = filesys_disk;               
+  struct list_elem *e;
+
+  if (frame_elem->flags & FRAME_MMAP)
+     disk = filesys_disk;               
 
   else
    {
      disk = swap_disk;
 
+     /* The page can no longer be read from an executable, 
+        if it has become dirty. */ 
+     if (frame_elem->flags & FRAME_EXEC)
+        frame_index_remove (frame_elem);
+     frame_elem->flags &= ~FRAME_EXEC;
+
      /* Find 8 consecutive free sectors on the swap disk. */
-     sector_no = bitmap_scan_and_flip (swap_freemap, 0, 8, false);
-     if (sector_no == BITMAP_ERROR)
+     if (!(frame_elem->flags & FRAME_SLOT))
       {
-        printf ("Out of virtual memory!!!!\n");
-        return;
+        sector_no = bitmap_scan_and_flip (swap_freemap, 0, 8, false);
+        if (sector_no == BITMAP_ERROR)
+           return false;
+        frame_elem->sector_no = sector_no;
+        frame_elem->flags |= FRAME_SLOT;
       }
-     frame_elem->sector_no = sector_no;
    }
+  sector_no = frame_elem->sector_no;
+
+  /* Clear the dirty bits before writing, so that a write to the
+     page from now on marks it dirty again. */
+  for (e = list_begin (&frame_elem->pte_list);
+       e != list_end (&frame_elem->pte_list);
+       e = list_next (e))
+    *list_entry (e, struct pte_elem, elem)->pte &= ~PTE_D;
+  frame_elem->flags &= ~FRAME_DIRTY;
 
-  /* Write the page sector by sector. */
   int i, read_bytes;
+
+  /* Only the bytes up to the last non-zero one of a page that
+     goes to the swap disk need to be kept. */
+  if (!(frame_elem->flags & FRAME_MMAP))
+   {
+     for (i = PGSIZE-1; i >= 0; i--)
+         if (page[i] != 0)
+            break;
+     frame_elem->read_bytes = i+1;
+   }
+
+  /* Write the page sector by sector. */
   read_bytes = (frame_elem->read_bytes > PGSIZE) ? 
                 PGSIZE : frame_elem->read_bytes;
 
+  if (background)
+   {
+     ASSERT (frame_elem->flags & FRAME_IO);
+     lock_release (&pg_fault_lock);
+   }
   for (i = 0; i < 8; i++)
     {
-      disk_write (disk, sector_no + i, (uint8_t *)page + DISK_SECTOR_SIZE *i);
+      disk_write (disk, sector_no + i, page + DISK_SECTOR_SIZE *i);
       read_bytes -= DISK_SECTOR_SIZE;
       if (read_bytes <= 0)
          break;
     }
+  if (background)
+     lock_acquire (&pg_fault_lock);
 
-done:
-
-  /* Now, free the memory utilized by the page. */
-  palloc_free_page (page);
-
+  if (background)
+     background_write_cnt++;
+  else
+     sync_write_cnt++;
+  return true;
 }
 
-void
+/* Reads FRAME_ELEM, which is swapped out, back into memory.
+   Returns false, leaving it swapped out, if no page could be
+   freed for it. */
+bool
 swap_in (struct frame_elem *frame_elem)
 {
   /* New page. */
-  void *page = palloc_get_page (PAL_USER | PAL_ZERO);
+  void *page = frame_get_page ();
   if (page == NULL)
-   {
-     evict (clock ());
-     page = palloc_get_page (PAL_USER | PAL_ZERO);
-   }
+     return false;
 
   size_t sector_no = frame_elem->sector_no;
   struct disk *disk;
@@ -128,15 +193,11 @@ swap_in (struct frame_elem *frame_elem)
            (frame_elem->flags & FRAME_EXEC))
      disk = filesys_disk;         
       
+  /* The page keeps its swap slot, so that it need not be
+     written again if it is evicted before it is modified. */
   else
-   {
      disk = swap_disk;
 
-     /* Clear the bits used by the page being swapped in. */
-     bitmap_set_multiple (swap_freemap, sector_no, 8, false);
-     frame_elem->sector_no = 0;
-   }
-
   /* Read the sectors onto the page, one by one. */
   int i, read_bytes;
   read_bytes = (frame_elem->read_bytes > PGSIZE) ? 
@@ -169,4 +230,14 @@ done:
     }
 
   frame_elem->flags &= ~FRAME_SWAP;
+  return true;
+}
+
+/* Prints writeback statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages written back at eviction, "
+          "%lld by the page cleaner\n",
+          sync_write_cnt, background_write_cnt);
 }
@@ -1,4 +1,7 @@
-#include "frame.h"
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include "vm/frame.h"
 #include "devices/disk.h"
 #include <bitmap.h>
 #define PTE_ELEM_SIZE sizeof (struct pte_elem)
@@ -7,4 +10,10 @@ void swap_init(void);
 
 void swap_out (struct frame_elem *);
 
-void swap_in (struct frame_elem *);
+bool swap_in (struct frame_elem *);
+
+bool swap_write (struct frame_elem *, bool background);
+
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */